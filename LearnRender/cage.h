@@ -1,19 +1,57 @@
 #pragma once
-#include <list>
-#include <random>
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <vector>
 
 #include "circle.h"
+#include "entity_table.h"
+#include "movement_kernel.h"
+#include "profiler.h"
 #include "util.h"
 #include "random_generators.h"
+#include "simulation_params.h"
+#include "simulation_clock.h"
+#include "spatial_grid.h"
+#include "thread_pool.h"
 
 class Cage {
-	std::list<Circle> circles{};
+	/**
+	 * Changes of the counters made by one thread during one phase of the update.
+	 **/
+	struct StageChanges {
+		int infected{};
+		int recovered{};
+		int dead{};
+	};
+
+	/**
+	 * The infected circle should recover or die at the time.
+	 **/
+	struct StageChangeEvent {
+		float time{};
+		EntityHandle circle;
+	};
+
+	CircleStorage circles{};
 	int population_size_{};
 	Coordinates coordinates_{};
 	float last_update_time_{};
+	SpatialGrid grid_;
+	// false once the rows may no longer be the ones grid_ was built from (circles added, moved out or in, written from outside)
+	bool grid_is_current_{};
+	std::vector<uint8_t> exposed_cells_;
+	std::vector<DiseaseStages> next_stage_;
+	std::vector<StageChanges> stage_changes_;
+	// min-heap by time; events of circles that have left the cage or have already changed are dropped when they are due
+	std::vector<StageChangeEvent> stage_change_events_;
+	std::vector<StageChangeEvent> postponed_events_;
+	// events of circles infected in this step, one list per worker
+	std::vector<std::vector<StageChangeEvent>> new_events_;
 public:
+	CageId id = NO_CAGE;
+	CounterRandom random;
+	SimulationParams params;
 	std::string name;
 	int susceptible{};
 	int infected{};
@@ -27,57 +65,126 @@ public:
 		coordinates_(coordinates),
 		name(name_),
 		susceptible(population_size) {
+		grid_.reset(coordinates_, 2 * CIRCLE_RADIUS);
 	}
 
-	void populate() {
-		Circle circle;
-		for (int i = 0; i < population_size_; i++) {
-			circle.direction.x = gen_random_float_number(-1.0f, 1.0f);
-			circle.direction.y = gen_random_float_number(-1.0f, 1.0f);
-			circle.center.x = gen_random_integer_number(coordinates_.top_left_corner.x, coordinates_.top_left_corner.x + coordinates_.width);
-			circle.center.y = gen_random_integer_number(coordinates_.top_left_corner.y, coordinates_.top_left_corner.y + coordinates_.height);
-			circle.home_cage = name;
-			circle.current_cage = circle.home_cage;
-			circles.push_back(circle);
-		}
+	/**
+	 * Add population_size circles with ids first_circle_id, first_circle_id + 1, ...
+	 * The storage grows once and ranges of circles are filled on the threads of the pool, if there is one.
+	 * Every circle gets its recovery time here, an infection only reads it.
+	 **/
+	void populate(int first_circle_id, ThreadPool* thread_pool = nullptr) {
+		const size_t first = circles.size();
+		circles.resize(first + population_size_);
+		grid_is_current_ = false;
+		const int left = static_cast<int>(coordinates_.top_left_corner.x);
+		const int top = static_cast<int>(coordinates_.top_left_corner.y);
+		forEachRange_(thread_pool, population_size_, CIRCLES_PER_TASK, [&](size_t begin, size_t end, size_t) {
+			for (size_t k = begin; k < end; k++) {
+				const size_t i = first + k;
+				const int circle_id = first_circle_id + static_cast<int>(k);
+				const auto placement = random.bits(circle_id, 0, RandomPurpose::PLACEMENT);
+				circles.x[i] = static_cast<float>(CounterRandom::toInteger(placement[0], left, left + coordinates_.width));
+				circles.y[i] = static_cast<float>(CounterRandom::toInteger(placement[1], top, top + coordinates_.height));
+				circles.dx[i] = -1.f + 2.f * CounterRandom::toUnitFloat(placement[2]);
+				circles.dy[i] = -1.f + 2.f * CounterRandom::toUnitFloat(placement[3]);
+				circles.stage[i] = DiseaseStages::SUSCEPTIBLE;
+				circles.id[i] = circle_id;
+				circles.handle[i] = EntityHandle{};
+				circles.moving_state[i] = CircleMovingState::RESTING;
+				circles.disease_stage_change_time[i] = 0;
+				circles.recovery_time[i] = drawRecoveryTime_(circle_id);
+				circles.arrived_in[i] = -1;
+				circles.home_cage[i] = id;
+				circles.destination_cage[i] = NO_CAGE;
+				circles.current_cage[i] = id;
+			}
+		});
 	}
 
-	void repopulate() {
+	void repopulate(int first_circle_id, ThreadPool* thread_pool = nullptr) {
 		circles.clear();
+		stage_change_events_.clear();
 		susceptible = population_size_;
 		infected = 0;
 		recovered = 0;
 		dead = 0;
-		populate();
+		populate(first_circle_id, thread_pool);
+	}
+
+	/**
+	 * Draw the recovery times of the susceptible circles again, after the seed or the parameters have changed.
+	 **/
+	void redrawRecoveryTimes(ThreadPool* thread_pool = nullptr) {
+		forEachRange_(thread_pool, circles.size(), CIRCLES_PER_TASK, [this](size_t begin, size_t end, size_t) {
+			for (size_t i = begin; i < end; i++) {
+				if (circles.stage[i] == DiseaseStages::SUSCEPTIBLE) {
+					circles.recovery_time[i] = drawRecoveryTime_(circles.id[i]);
+				}
+			}
+		});
 	}
 
+	/**
+	 * Infect the first number_of_infected_to_populate susceptible circles of the cage.
+	 **/
 	void populateInfected(int number_of_infected_to_populate, float infection_time) {
-		if (number_of_infected_to_populate > population_size_ || number_of_infected_to_populate <= 0) {
+		const auto susceptible_circles = std::count(circles.stage.begin(), circles.stage.end(), DiseaseStages::SUSCEPTIBLE);
+		if (number_of_infected_to_populate > susceptible_circles || number_of_infected_to_populate <= 0) {
 			throw std::out_of_range("Number of infected to populate is invalid");
 		}
-		auto circle = circles.begin();
-		while (number_of_infected_to_populate--) {
-			circle->recovery_time = gen_random_integer_number(RECOVERY_TIME_MIN, RECOVERY_TIME_MAX);
-			
-			circle->disease_stage = DiseaseStages::INFECTED;
-			circle->disease_stage_change_time = infection_time;
-			circle = ++circle;
+		int left = number_of_infected_to_populate;
+		for (size_t i = 0; i < circles.size() && left > 0; i++) {
+			if (circles.stage[i] != DiseaseStages::SUSCEPTIBLE) continue;
+			circles.stage[i] = DiseaseStages::INFECTED;
+			circles.disease_stage_change_time[i] = infection_time;
+			scheduleStageChange_(circles.handle[i], infection_time, circles.recovery_time[i]);
+			left--;
 		}
-		infected = number_of_infected_to_populate;
+		infected += number_of_infected_to_populate;
 		susceptible -= number_of_infected_to_populate;
 	}
 
-	void update(const float current_time) {
-		if (SIMULATION_SPEED != 0.0f) {
-			moveCircles_(current_time - last_update_time_);
-			changeDiseaseStageOverTime_(current_time);
-			markIntersectionCircles_(current_time);
+	/**
+	 * Cages with at least PARALLEL_CAGE_MIN_POPULATION circles are updated by all threads of the pool.
+	 * The result is the same for any number of threads.
+	 * entities tells where circles are, it is only read.
+	 **/
+	void update(const SimulationClock& clock, const EntityTable& entities, ThreadPool* thread_pool = nullptr) {
+		ThreadPool* pool = circles.size() >= static_cast<size_t>(PARALLEL_CAGE_MIN_POPULATION) ? thread_pool : nullptr;
+		{
+			PROFILE_SCOPE("Cage::update move");
+			moveCircles_(clock.current_time - last_update_time_, pool);
+		}
+		{
+			PROFILE_SCOPE("Cage::update stage");
+			changeDiseaseStageOverTime_(clock.current_time, entities);
 		}
+		{
+			PROFILE_SCOPE("Cage::update infect");
+			markIntersectionCircles_(clock.current_time, clock.current_time - last_update_time_, clock.step, pool);
+		}
+
+		last_update_time_ = clock.current_time;
+	}
+
+	/**
+	 * Time of the last update, circles move by the time passed since then.
+	 **/
+	float getLastUpdateTime() const {
+		return last_update_time_;
+	}
 
-		last_update_time_ = current_time;
+	void setLastUpdateTime(float time) {
+		last_update_time_ = time;
 	}
 
-	std::list<Circle> getCircles() const {
+	const CircleStorage& getCircles() const {
+		return circles;
+	}
+
+	CircleStorage& getCircles() {
+		grid_is_current_ = false;
 		return circles;
 	}
 
@@ -85,69 +192,153 @@ public:
 		return population_size_;
 	}
 
-	void removeCircle(const std::list<Circle>::iterator& circle_iterator) {
-		circles.erase(circle_iterator);
+	/**
+	 * Move the circle at the index to the destination cage and return its index there.
+	 * The last circle of this cage takes the freed index.
+	 **/
+	size_t moveCircleTo(size_t index, Cage& destination) {
+		if (circles.stage[index] == DiseaseStages::INFECTED) {
+			destination.scheduleStageChange_(circles.handle[index], circles.disease_stage_change_time[index], circles.recovery_time[index]);
+		}
+		grid_is_current_ = false;
+		destination.grid_is_current_ = false;
+		return circles.moveTo(index, destination.circles);
 	}
 
-	void markIntersectionCircles_(const float& current_time) {
-		std::uniform_real_distribution<float> infect_distribution(0, 1);
-		for (auto& covidCircle : circles) {
-			if (covidCircle.disease_stage == DiseaseStages::INFECTED) {
-				for (auto& circle : circles) {
-					if (circle.disease_stage == DiseaseStages::SUSCEPTIBLE && intersect(covidCircle, circle) && gen_random_float_number(0, 1) < INFECTION_PROBABILITY) {
-						circle.disease_stage = DiseaseStages::INFECTED;
-						
-						circle.recovery_time = gen_random_integer_number(RECOVERY_TIME_MIN, RECOVERY_TIME_MAX);
-						circle.disease_stage_change_time = current_time;
-						susceptible--;
-						infected++;
-					}
-				}
+	/**
+	 * Schedule the stage changes of all infected circles anew, after the circles were put into the cage directly.
+	 **/
+	void rescheduleStageChanges() {
+		stage_change_events_.clear();
+		for (size_t i = 0; i < circles.size(); i++) {
+			if (circles.stage[i] == DiseaseStages::INFECTED) {
+				scheduleStageChange_(circles.handle[i], circles.disease_stage_change_time[i], circles.recovery_time[i]);
 			}
 		}
 	}
 
-	void moveCircles_(const float& delta_time) {
-		for (auto& circle : circles) {
-			if (circle.disease_stage == DiseaseStages::DEAD) continue;
-			glm::vec2 oldCenter = circle.center;
-			glm::vec2 newCenter = circle.center + circle.direction * delta_time;
-			circle.center = newCenter;
-			glm::vec2* intersection = outsideViewport_(circle);
-			if (circle.circle_moving_state==CircleMovingState::RESTING && intersection) {
-				circle.center = oldCenter;
-				reflectVector2(circle.direction, *intersection);
+	/**
+	 * Every susceptible circle looks for infected circles around it. Stages are double buffered: new stages are written
+	 * to next_stage_ while the current ones are read, so a circle infected in this step infects nobody until the next step
+	 * and the result does not depend on the order of circles or on the number of threads.
+	 * Bands of grid rows are processed in parallel; a thread writes only the circles of its band.
+	 * Every infected circle in contact gets one chance to infect, with the probability of a contact that lasted delta_time.
+	 **/
+	void markIntersectionCircles_(const float& current_time, float delta_time, uint64_t step, ThreadPool* pool = nullptr) {
+		const float interaction_distance_squared = 4 * CIRCLE_RADIUS * CIRCLE_RADIUS;
+		const float infection_probability = params.infectionProbability(delta_time);
+		grid_.build(circles.size(), [this](size_t i) { return circles.center(i); });
+		grid_is_current_ = true;
+
+		// cells that are close enough to an infected circle, others are skipped
+		exposed_cells_.assign(grid_.cellCount(), 0);
+		bool any_infected = false;
+		for (size_t i = 0; i < circles.size(); i++) {
+			if (circles.stage[i] == DiseaseStages::INFECTED) {
+				grid_.forEachNeighbourCell(circles.center(i), [this](int cell) { exposed_cells_[cell] = 1; });
+				any_infected = true;
 			}
-			circle.center += circle.direction * delta_time;
 		}
-	}
+		if (!any_infected) return;
 
-	glm::vec2* outsideViewport_(const Circle& c) const {
-		if (c.center.x > coordinates_.top_left_corner.x + coordinates_.width)
-			return Intersection::RIGHT;
-		if (c.center.y > coordinates_.top_left_corner.y + coordinates_.height)
-			return Intersection::TOP;
-		if (c.center.x < coordinates_.top_left_corner.x)
-			return Intersection::LEFT;
-		if (c.center.y < coordinates_.top_left_corner.y)
-			return Intersection::BOTTOM;
-		return Intersection::NO_INTERSECTION;
-	}
-
-	void changeDiseaseStageOverTime_(const float& current_time) {
-		for (auto& circle : circles) {
-			float dTime = current_time - circle.disease_stage_change_time;
-			if (circle.disease_stage == DiseaseStages::INFECTED && dTime >= circle.recovery_time) {
-				if (gen_random_float_number(0, 1) < DEATH_PROBABILITY) {
-					circle.disease_stage = DiseaseStages::DEAD;
-					dead++;
-				} else {
-					circle.disease_stage = DiseaseStages::RECOVERED;
-					recovered++;
+		next_stage_ = circles.stage;
+		resetStageChanges_(pool);
+		new_events_.resize(stage_changes_.size());
+		const size_t rows = grid_.rows();
+		const size_t rows_per_band = pool ? std::max<size_t>(1, rows / (4 * pool->concurrency())) : rows;
+		forEachRange_(pool, rows, rows_per_band, [&](size_t first_row, size_t last_row, size_t worker) {
+			grid_.forEachItemInRows(static_cast<int>(first_row), static_cast<int>(last_row), [&](uint32_t j, int cell) {
+				if (circles.stage[j] != DiseaseStages::SUSCEPTIBLE || !exposed_cells_[cell]) return;
+				const glm::vec2 center = circles.center(j);
+				bool is_infected = false;
+				grid_.forEachNeighbour(center, [&](uint32_t i) {
+					if (is_infected || circles.stage[i] != DiseaseStages::INFECTED) return;
+					const glm::vec2 diff = circles.center(i) - center;
+					is_infected = diff.x * diff.x + diff.y * diff.y <= interaction_distance_squared
+						&& random.uniform(circles.id[j], step, RandomPurpose::INFECTION, circles.id[i]) < infection_probability;
+				});
+				if (is_infected) {
+					next_stage_[j] = DiseaseStages::INFECTED;
+					circles.disease_stage_change_time[j] = current_time;
+					new_events_[worker].push_back(StageChangeEvent{ stageChangeTime_(current_time, circles.recovery_time[j]), circles.handle[j] });
+					stage_changes_[worker].infected++;
 				}
-				infected--;
+			});
+		});
+		std::swap(circles.stage, next_stage_);
+		for (auto& events : new_events_) {
+			for (const auto& event : events) {
+				pushEvent_(event);
+			}
+			events.clear();
+		}
+		const StageChanges changes = sumStageChanges_();
+		susceptible -= changes.infected;
+		infected += changes.infected;
+	}
+
+	void moveCircles_(const float& delta_time, ThreadPool* pool = nullptr) {
+		const MovementBatch batch{
+			circles.x.data(), circles.y.data(), circles.dx.data(), circles.dy.data(),
+			circles.stage.data(), circles.moving_state.data(),
+			delta_time,
+			coordinates_.top_left_corner.x, coordinates_.top_left_corner.y,
+			coordinates_.top_left_corner.x + coordinates_.width, coordinates_.top_left_corner.y + coordinates_.height
+		};
+		forEachRange_(pool, circles.size(), CIRCLES_PER_TASK, [&batch](size_t begin, size_t end, size_t) {
+			moveCirclesKernel(batch, begin, end);
+		});
+	}
+
+	/**
+	 * Recover or kill the infected circles whose time has come. Only due events are looked at, so the cost
+	 * is proportional to the number of stage changes and not to the population.
+	 **/
+	void changeDiseaseStageOverTime_(const float& current_time, const EntityTable& entities) {
+		StageChanges changes;
+		while (!stage_change_events_.empty() && stage_change_events_.front().time <= current_time) {
+			std::pop_heap(stage_change_events_.begin(), stage_change_events_.end(), laterEvent_);
+			const StageChangeEvent event = stage_change_events_.back();
+			stage_change_events_.pop_back();
+			if (!entities.isValid(event.circle)) continue;
+			const EntityLocation& location = entities.locate(event.circle);
+			if (location.cage != id) continue;
+			const size_t i = location.index;
+			if (circles.stage[i] != DiseaseStages::INFECTED) continue;
+			if (current_time - circles.disease_stage_change_time[i] < circles.recovery_time[i]) {
+				// an event older than the infection of the circle: due again when this infection ends
+				postponed_events_.push_back(StageChangeEvent{ stageChangeTime_(circles.disease_stage_change_time[i], circles.recovery_time[i]), event.circle });
+				continue;
 			}
+			if (random.uniform(circles.id[i], 0, RandomPurpose::DEATH) < params.death_probability) {
+				circles.stage[i] = DiseaseStages::DEAD;
+				changes.dead++;
+			} else {
+				circles.stage[i] = DiseaseStages::RECOVERED;
+				changes.recovered++;
+			}
+		}
+		for (const auto& event : postponed_events_) {
+			pushEvent_(event);
 		}
+		postponed_events_.clear();
+		dead += changes.dead;
+		recovered += changes.recovered;
+		infected -= changes.dead + changes.recovered;
+	}
+
+	/**
+	 * Cells of the circles after the last update, also used to draw the cage as a heatmap.
+	 **/
+	const SpatialGrid& getGrid() const {
+		return grid_;
+	}
+
+	/**
+	 * Whether the items of the grid are still the rows of the circles, so that itemCell(i) is the cell of circle i.
+	 **/
+	bool isGridCurrent() const {
+		return grid_is_current_;
 	}
 
 	bool surrounds(glm::vec2 center) const {
@@ -160,25 +351,74 @@ public:
 		return false;
 	}
 
-	std::list<Circle>::iterator addCircle(std::list<Circle>::iterator& value) {
-		circles.emplace_back(*value);
-		return std::prev(circles.end());
-	}
-
 	Coordinates getCoordinates() const {
 		return coordinates_;
 	}
 
-	std::vector<std::list<Circle>::iterator> addDestination(std::string& destination_cage_name, int amount_of_circles) {
-		std::vector<std::list<Circle>::iterator> iterators;
-		auto circle_iterator = circles.begin();
-		while(circle_iterator != circles.end() && amount_of_circles-- > 0) {
-			if (!circle_iterator->destination_cage.empty()) continue;
-			circle_iterator->destination_cage = destination_cage_name;
-			circle_iterator->circle_moving_state = CircleMovingState::MOVING_TO_DESTINATION_CAGE;
-			iterators.emplace_back(circle_iterator);
-			++circle_iterator;
+	void addDestination(CageId destination_cage, int amount_of_circles) {
+		for (size_t i = 0; i < circles.size() && amount_of_circles > 0; i++) {
+			if (circles.destination_cage[i] != NO_CAGE) continue;
+			circles.destination_cage[i] = destination_cage;
+			circles.moving_state[i] = CircleMovingState::MOVING_TO_DESTINATION_CAGE;
+			amount_of_circles--;
 		}
-		return iterators;
+	}
+
+private:
+	static constexpr size_t CIRCLES_PER_TASK = 8192;
+
+	/**
+	 * Call function(begin, end, worker) for consecutive ranges of [0, count) of at most range_size elements,
+	 * on the threads of the pool if there is one.
+	 **/
+	template <typename Function>
+	static void forEachRange_(ThreadPool* pool, size_t count, size_t range_size, Function function) {
+		if (!pool) {
+			function(0, count, 0);
+			return;
+		}
+		const size_t ranges = (count + range_size - 1) / range_size;
+		pool->parallelFor(ranges, [&](size_t range, size_t worker) {
+			function(range * range_size, std::min(count, (range + 1) * range_size), worker);
+		});
+	}
+
+	/**
+	 * A little before change_time + recovery_time, so rounding never delays a stage change;
+	 * an event that comes too early is postponed by a step.
+	 **/
+	static float stageChangeTime_(float change_time, float recovery_time) {
+		return change_time + recovery_time - (std::abs(change_time) + std::abs(recovery_time)) * 1e-6f;
+	}
+
+	static bool laterEvent_(const StageChangeEvent& a, const StageChangeEvent& b) {
+		return a.time > b.time;
+	}
+
+	void pushEvent_(const StageChangeEvent& event) {
+		stage_change_events_.push_back(event);
+		std::push_heap(stage_change_events_.begin(), stage_change_events_.end(), laterEvent_);
+	}
+
+	void scheduleStageChange_(EntityHandle circle, float change_time, float recovery_time) {
+		pushEvent_(StageChangeEvent{ stageChangeTime_(change_time, recovery_time), circle });
+	}
+
+	void resetStageChanges_(ThreadPool* pool) {
+		stage_changes_.assign(pool ? pool->concurrency() : 1, StageChanges());
+	}
+
+	StageChanges sumStageChanges_() const {
+		StageChanges sum;
+		for (const auto& changes : stage_changes_) {
+			sum.infected += changes.infected;
+			sum.recovered += changes.recovered;
+			sum.dead += changes.dead;
+		}
+		return sum;
+	}
+
+	float drawRecoveryTime_(int circle_id) const {
+		return random.uniformInteger(params.recovery_time_min, params.recovery_time_max, circle_id, 0, RandomPurpose::RECOVERY_TIME);
 	}
 };
\ No newline at end of file
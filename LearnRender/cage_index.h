@@ -0,0 +1,94 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glm/common.hpp>
+#include <glm/vec2.hpp>
+
+#include "circle.h"
+#include "util.h"
+
+/**
+ *	Uniform grid over the bounding box of the cages.
+ *	Every cell keeps the ids of the cages whose rectangles overlap it, in increasing order,
+ *	so a point is tested only against the few cages of its cell instead of all of them.
+ *	Cages do not move, the grid is rebuilt only when the set of cages changes.
+ **/
+class CageIndex {
+	glm::vec2 origin_{};
+	glm::vec2 end_{};
+	glm::vec2 inverse_cell_size_{};
+	int columns_ = 0;
+	int rows_ = 0;
+	std::vector<int> cell_start_;
+	std::vector<CageId> cage_ids_;
+
+public:
+	/**
+	 * rectangle(id) must return the Coordinates of the cage id for every id in [0, count).
+	 **/
+	template <typename Rectangle>
+	void build(size_t count, Rectangle rectangle) {
+		columns_ = rows_ = 0;
+		cell_start_.clear();
+		cage_ids_.clear();
+		if (count == 0) return;
+
+		glm::vec2 min_corner = rectangle(0).top_left_corner, max_corner = min_corner;
+		for (size_t id = 0; id < count; id++) {
+			const Coordinates coordinates = rectangle(static_cast<CageId>(id));
+			min_corner = glm::min(min_corner, coordinates.top_left_corner);
+			max_corner = glm::max(max_corner, coordinates.top_left_corner + glm::vec2(coordinates.width, coordinates.height));
+		}
+		// About one cell per cage, so a cell is usually overlapped by one or two cages.
+		const int side = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count)))));
+		origin_ = min_corner;
+		end_ = max_corner;
+		columns_ = rows_ = side;
+		const glm::vec2 size = glm::max(max_corner - min_corner, glm::vec2(1.f, 1.f));
+		inverse_cell_size_ = glm::vec2(side / size.x, side / size.y);
+
+		cell_start_.assign(static_cast<size_t>(columns_) * rows_ + 1, 0);
+		for (size_t id = 0; id < count; id++) {
+			forEachCell_(rectangle(static_cast<CageId>(id)), [this](int cell) { cell_start_[cell + 1]++; });
+		}
+		for (size_t i = 1; i < cell_start_.size(); i++) {
+			cell_start_[i] += cell_start_[i - 1];
+		}
+		cage_ids_.resize(cell_start_.back());
+		std::vector<int> cursor(cell_start_.begin(), cell_start_.end() - 1);
+		for (size_t id = 0; id < count; id++) {
+			forEachCell_(rectangle(static_cast<CageId>(id)), [this, &cursor, id](int cell) { cage_ids_[cursor[cell]++] = static_cast<CageId>(id); });
+		}
+	}
+
+	/**
+	 * Call visit(id) for every cage that may contain the point, in increasing order of ids.
+	 **/
+	template <typename Visitor>
+	void forEachCandidate(glm::vec2 point, Visitor visit) const {
+		if (columns_ == 0) return;
+		if (point.x < origin_.x || point.y < origin_.y || point.x > end_.x || point.y > end_.y) return;
+		const glm::vec2 cell = (point - origin_) * inverse_cell_size_;
+		const int index = std::min(static_cast<int>(cell.y), rows_ - 1) * columns_ + std::min(static_cast<int>(cell.x), columns_ - 1);
+		for (int k = cell_start_[index]; k < cell_start_[index + 1]; k++) {
+			visit(cage_ids_[k]);
+		}
+	}
+
+private:
+	template <typename Function>
+	void forEachCell_(const Coordinates& coordinates, Function function) const {
+		const glm::vec2 first = (coordinates.top_left_corner - origin_) * inverse_cell_size_;
+		const glm::vec2 last = (coordinates.top_left_corner + glm::vec2(coordinates.width, coordinates.height) - origin_) * inverse_cell_size_;
+		const int first_column = std::clamp(static_cast<int>(first.x), 0, columns_ - 1);
+		const int last_column = std::clamp(static_cast<int>(last.x), 0, columns_ - 1);
+		const int first_row = std::clamp(static_cast<int>(first.y), 0, rows_ - 1);
+		const int last_row = std::clamp(static_cast<int>(last.y), 0, rows_ - 1);
+		for (int row = first_row; row <= last_row; row++) {
+			for (int column = first_column; column <= last_column; column++) {
+				function(row * columns_ + column);
+			}
+		}
+	}
+};
@@ -1,105 +1,134 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include <fstream>
 #include <filesystem>
+#include <stdexcept>
 
 #include "cage.h"
 #include "circle.h"
 #include "canvas.h"
+#include "profiler.h"
 #include "settings.h"
 
 
 struct Flow
 {
-	std::string source;
-	std::string destination;
-	int amount;
+	CageId source = NO_CAGE;
+	CageId destination = NO_CAGE;
+	int amount{};
 
 	Flow() = default;
 	
-	Flow(std::string source_, std::string destination_, int amount_) : source(source_), destination(destination_), amount(amount_) {}
+	Flow(CageId source_, CageId destination_, int amount_) : source(source_), destination(destination_), amount(amount_) {}
 };
 
 /**
  *	Control the behavior of circles that move between cages.
- *	Circle moves to a destination cage and hangs out there for the TIME_TO_REST_IN_CAGE.
+ *	Circle moves to a destination cage and hangs out there for the time to rest in a cage from the parameters of the canvas.
  *	When the time runs out circle goes back to home cage and rest there for the same time.
+ *	The time to rest is drawn once, when the circle arrives, and its departure is put into a priority queue;
+ *	a step looks only at the departures that are due.
  *	The class also processes encounters of circles with cages that might be on the their way to destination cage or home cage.
  **/
 class CageMediator {
+	/**
+	 * Circle that has entered another cage. Transfers are collected while cages are processed in parallel
+	 * and applied afterwards on one thread. index is where the circle was found and only orders the transfers.
+	 **/
+	struct Transfer {
+		CageId source;
+		uint32_t index;
+		EntityHandle circle;
+		CageId destination;
+	};
+
+	/**
+	 * The circle that arrived at arrived_in leaves at time. Departures of circles that have been
+	 * destroyed or have left in another way are dropped when they are due.
+	 **/
+	struct Departure {
+		float time;
+		float arrived_in;
+		EntityHandle circle;
+	};
+
 	Canvas* canvas_;
-	std::vector<std::list<Circle>::iterator> moving_circles;
 	std::vector<Flow>flows_;
+	std::vector<std::vector<Transfer>> transfers_;
+	std::vector<Transfer> sorted_transfers_;
+	// min-heap by time
+	std::vector<Departure> departures_;
 
 public:
 	CageMediator(Canvas* canvas) : canvas_(canvas) {}
 
-	void addMovingCircle(std::list<Circle>::iterator& circle_iterator) {
-		moving_circles.emplace_back(circle_iterator);
-	}
+	void update(const SimulationClock& clock) {
+		PROFILE_SCOPE("CageMediator::update");
+		startDueDepartures_(clock.current_time);
 
-	void update(const float& current_time) {
-		for (size_t i = 0; i < moving_circles.size(); i++) {
-			for (auto& [cage_name, cage] : canvas_->getCages()) {
+		transfers_.resize(canvas_->concurrency());
+		for (auto& transfers : transfers_) {
+			transfers.clear();
+		}
+
+		canvas_->parallelForEachCage([this](Cage& source, size_t worker) {
+			CircleStorage& circles = source.getCircles();
+			for (size_t i = 0; i < circles.size(); i++) {
+				if (circles.destination_cage[i] == NO_CAGE) continue;
 
 				// If true - circle is in the cage that is not its home cage and circle is not resting there.
 				// There are two ways how it can be possible:
 				// 1. circle goes to a destination cage through another cage
 				// 2. circle has come to a destination cage
-				if (cage.surrounds(moving_circles[i]->center) && (cage_name != moving_circles[i]->current_cage)) {
-
-					// substitute the iterator with the new one that is working within the new cage
-					auto old_iterator = moving_circles[i];
-					moving_circles[i] = cage.addCircle(old_iterator);
-					(*canvas_)[moving_circles[i]->current_cage].removeCircle(old_iterator);
-					moving_circles[i]->current_cage = cage_name;
-
-					if ( // circle has come to a destination cage
-						moving_circles[i]->circle_moving_state == CircleMovingState::MOVING_TO_DESTINATION_CAGE
-						&& cage_name == moving_circles[i]->destination_cage
-						&& moving_circles[i]->arrived_in < 0
-						) {
-						moving_circles[i]->circle_moving_state = CircleMovingState::RESTING;
-						moving_circles[i]->arrived_in = current_time;
-					} else if ( // circle has come to the home cage
-						moving_circles[i]->circle_moving_state == CircleMovingState::MOVING_TO_HOME_CAGE
-						&& cage_name == moving_circles[i]->home_cage
-						&& moving_circles[i]->arrived_in < 0
-						) {
-						moving_circles[i]->circle_moving_state = CircleMovingState::RESTING;
-						moving_circles[i]->arrived_in = current_time;
-					}
-
-					// otherwise the cage should be passed without stopping
+				CageId entered_cage = canvas_->findCageAt(circles.center(i), circles.current_cage[i]);
+				if (entered_cage != NO_CAGE) {
+					transfers_[worker].push_back(Transfer{ source.id, static_cast<uint32_t>(i), circles.handle[i], entered_cage });
 				}
 			}
+		});
 
-			// if true - time to get out of the cage
-			float time_to_rest_in_cage = gen_random_float_number(TIME_TO_REST_IN_CAGE_MIN, TIME_TO_REST_IN_CAGE_MAX);
-			if (moving_circles[i]->circle_moving_state == CircleMovingState::RESTING
-				&& moving_circles[i]->arrived_in >= 0
-				&& current_time - moving_circles[i]->arrived_in >= time_to_rest_in_cage
-				) {
-				moving_circles[i]->arrived_in = -1;
-				moving_circles[i]->circle_moving_state =
-					moving_circles[i]->current_cage == moving_circles[i]->home_cage
-					? CircleMovingState::MOVING_TO_DESTINATION_CAGE
-					: CircleMovingState::MOVING_TO_HOME_CAGE;
-			}
-			if (moving_circles[i]->circle_moving_state == CircleMovingState::MOVING_TO_DESTINATION_CAGE) {
-				moving_circles[i]->direction = calculateCircleDirectionByCageName_(moving_circles[i]->center, moving_circles[i]->destination_cage);
-			} else if (moving_circles[i]->circle_moving_state == CircleMovingState::MOVING_TO_HOME_CAGE) {
-				moving_circles[i]->direction = calculateCircleDirectionByCageName_(moving_circles[i]->center, moving_circles[i]->home_cage);
-			}
-		}
+		commitTransfers_(clock.current_time);
 	}
 
 	void addDestination(Flow flow) {
 		flows_.push_back(Flow(flow.source, flow.destination, flow.amount));
-		std::vector<std::list<Circle>::iterator> iterators = (*canvas_)[flow.source].addDestination(flow.destination, flow.amount);
-		for (auto& iterator : iterators) {
-			addMovingCircle(iterator);
+		(*canvas_)[flow.source].addDestination(flow.destination, flow.amount);
+		// circles that got the destination set off at once
+		CircleStorage& circles = (*canvas_)[flow.source].getCircles();
+		for (size_t i = 0; i < circles.size(); i++) {
+			if (circles.destination_cage[i] == flow.destination && circles.moving_state[i] == CircleMovingState::MOVING_TO_DESTINATION_CAGE) {
+				headTowards_(circles, i, flow.destination);
+			}
+		}
+	}
+
+	const std::vector<Flow>& getFlows() const {
+		return flows_;
+	}
+
+	/**
+	 * Replace the flows without giving destinations to circles, for circles that already have them.
+	 **/
+	void restoreFlows(std::vector<Flow> flows) {
+		flows_ = std::move(flows);
+	}
+
+	/**
+	 * Put the departures of all resting circles into the queue anew, after the circles were put into the cages
+	 * directly and got their handles. The times to rest are drawn as on arrival, so they are the same as before.
+	 **/
+	void rescheduleDepartures() {
+		departures_.clear();
+		for (const auto& cage : canvas_->getCages()) {
+			const CircleStorage& circles = cage.getCircles();
+			for (size_t i = 0; i < circles.size(); i++) {
+				if (circles.destination_cage[i] != NO_CAGE && circles.moving_state[i] == CircleMovingState::RESTING && circles.arrived_in[i] >= 0) {
+					scheduleDeparture_(circles, i);
+				}
+			}
 		}
 	}
 
@@ -109,14 +138,14 @@ public:
 		std::ofstream out(DIRECTORY_FOR_SAVES + "/" + file_name, std::ios::out | std::ios::app);
 		
 		out << canvas_->getCages().size() << "\n";
-		for (const auto& [name, cage] : canvas_->getCages()) {
-			out << name << "\n";
+		for (const auto& cage : canvas_->getCages()) {
+			out << cage.name << "\n";
 			out << cage.getCoordinates().top_left_corner.x << " " << cage.getCoordinates().top_left_corner.y << " " << cage.getCoordinates().width << " " << cage.getCoordinates().height << "\n";
 			out << cage.getPopulationSize() << "\n";
 		}
 		out << flows_.size() << "\n";
 		for (const auto& flow : flows_) {
-			out << flow.source << " " << flow.destination << " " << flow.amount << "\n";
+			out << (*canvas_)[flow.source].name << " " << (*canvas_)[flow.destination].name << " " << flow.amount << "\n";
 		}
 		out.close();
 		return file_name;
@@ -124,14 +153,16 @@ public:
 
 	void clearData() {
 		flows_.clear();
-		moving_circles.clear();
+		departures_.clear();
 		canvas_->clear_data();
 	}
 	
 	void load(const std::string& file_name) {
 		clearData();
-		SIMULATION_SPEED = 0;
 		std::ifstream in(file_name);
+		if (!in) {
+			throw std::runtime_error("Could not open the save file " + file_name);
+		}
 		int cages_number, flows_number;
 		in >> cages_number;
 		while(cages_number--) {
@@ -143,22 +174,114 @@ public:
 			canvas_->addCage(Cage(population_size, cage_coordinates, cage_name));
 		}
 		in >> flows_number;
-		if (flows_number) {
-			for (auto& [name, cage] : canvas_->getCages()) {
-				cage.repopulate();
-			}
+		for (auto& cage : canvas_->getCages()) {
+			canvas_->repopulate(cage.id);
 		}
 		while (flows_number--) {
-			Flow flow;
-			in >> flow.source >> flow.destination >> flow.amount;
-			flows_.push_back(flow);
-			addDestination(flow);
+			std::string source, destination;
+			int amount;
+			in >> source >> destination >> amount;
+			addDestination(Flow(canvas_->findCageId(source), canvas_->findCageId(destination), amount));
 		}
 	}
 
 private:
-	glm::vec2 calculateCircleDirectionByCageName_(glm::vec2 circle_center, std::string& cage_name) const {
-		Coordinates cage_coordinates = (*canvas_)[cage_name].getCoordinates();
+	/**
+	 * Move circles to the cages they have entered.
+	 * Transfers are applied in the order of their source cages and from the biggest index to the smallest one,
+	 * so the result does not depend on the threads that found them.
+	 **/
+	void commitTransfers_(const float& current_time) {
+		sorted_transfers_.clear();
+		for (const auto& transfers : transfers_) {
+			sorted_transfers_.insert(sorted_transfers_.end(), transfers.begin(), transfers.end());
+		}
+		std::sort(sorted_transfers_.begin(), sorted_transfers_.end(), [](const Transfer& a, const Transfer& b) {
+			return a.source != b.source ? a.source < b.source : a.index > b.index;
+		});
+
+		for (const auto& transfer : sorted_transfers_) {
+			const size_t i = canvas_->moveCircle(transfer.circle, transfer.destination);
+			CircleStorage& circles = (*canvas_)[transfer.destination].getCircles();
+			circles.current_cage[i] = transfer.destination;
+
+			if ( // circle has come to a destination cage
+				circles.moving_state[i] == CircleMovingState::MOVING_TO_DESTINATION_CAGE
+				&& transfer.destination == circles.destination_cage[i]
+				&& circles.arrived_in[i] < 0
+				) {
+				circles.moving_state[i] = CircleMovingState::RESTING;
+				circles.arrived_in[i] = current_time;
+				scheduleDeparture_(circles, i);
+			} else if ( // circle has come to the home cage
+				circles.moving_state[i] == CircleMovingState::MOVING_TO_HOME_CAGE
+				&& transfer.destination == circles.home_cage[i]
+				&& circles.arrived_in[i] < 0
+				) {
+				circles.moving_state[i] = CircleMovingState::RESTING;
+				circles.arrived_in[i] = current_time;
+				scheduleDeparture_(circles, i);
+			}
+
+			// otherwise the cage should be passed without stopping
+		}
+	}
+
+	static bool laterDeparture_(const Departure& a, const Departure& b) {
+		return a.time > b.time;
+	}
+
+	/**
+	 * The time to rest is a function of the circle and its arrival time, so it can be drawn again after a restore.
+	 **/
+	void scheduleDeparture_(const CircleStorage& circles, size_t i) {
+		const SimulationParams& params = canvas_->getParams();
+		uint32_t arrival_bits;
+		std::memcpy(&arrival_bits, &circles.arrived_in[i], sizeof(arrival_bits));
+		const float time_to_rest_in_cage = canvas_->getRandom().uniform(
+			params.time_to_rest_in_cage_min, params.time_to_rest_in_cage_max, circles.id[i], arrival_bits, RandomPurpose::TIME_TO_REST_IN_CAGE
+		);
+		departures_.push_back(Departure{ circles.arrived_in[i] + time_to_rest_in_cage, circles.arrived_in[i], circles.handle[i] });
+		std::push_heap(departures_.begin(), departures_.end(), laterDeparture_);
+	}
+
+	/**
+	 * Circles whose time to rest has run out go to the other end of their way.
+	 **/
+	void startDueDepartures_(float current_time) {
+		const EntityTable& entities = canvas_->getEntities();
+		while (!departures_.empty() && departures_.front().time <= current_time) {
+			std::pop_heap(departures_.begin(), departures_.end(), laterDeparture_);
+			const Departure departure = departures_.back();
+			departures_.pop_back();
+			if (!entities.isValid(departure.circle)) continue;
+			const EntityLocation& location = entities.locate(departure.circle);
+			CircleStorage& circles = (*canvas_)[location.cage].getCircles();
+			const size_t i = location.index;
+			if (circles.moving_state[i] != CircleMovingState::RESTING || circles.arrived_in[i] != departure.arrived_in) continue;
+
+			circles.arrived_in[i] = -1;
+			if (circles.current_cage[i] == circles.home_cage[i]) {
+				circles.moving_state[i] = CircleMovingState::MOVING_TO_DESTINATION_CAGE;
+				headTowards_(circles, i, circles.destination_cage[i]);
+			} else {
+				circles.moving_state[i] = CircleMovingState::MOVING_TO_HOME_CAGE;
+				headTowards_(circles, i, circles.home_cage[i]);
+			}
+		}
+	}
+
+	/**
+	 * Circles move in straight lines, so the direction is set once when they set off.
+	 **/
+	void headTowards_(CircleStorage& circles, size_t i, CageId cage_id) const {
+		const glm::vec2 direction = calculateCircleDirectionByCageId_(circles.center(i), cage_id);
+		circles.dx[i] = direction.x;
+		circles.dy[i] = direction.y;
+	}
+
+	glm::vec2 calculateCircleDirectionByCageId_(glm::vec2 circle_center, CageId cage_id) const {
+		Coordinates cage_coordinates = (*canvas_)[cage_id].getCoordinates();
 		float cage_center_x = cage_coordinates.top_left_corner.x + cage_coordinates.width / 2. - circle_center.x;
 		float cage_center_y = cage_coordinates.top_left_corner.y + cage_coordinates.height / 2. - circle_center.y;
 		float max_coordinate = std::max(abs(cage_center_x), abs(cage_center_y));
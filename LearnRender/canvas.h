@@ -1,58 +1,269 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 #include "cage.h"
+#include "cage_index.h"
+#include "entity_table.h"
+#include "metrics_exporter.h"
+#include "profiler.h"
+#include "thread_pool.h"
 #include "util.h"
 
+struct DiseaseTotals {
+	int susceptible{};
+	int infected{};
+	int recovered{};
+	int dead{};
+};
+
 class Canvas {
 	int number_of_cages_{};
 	Coordinates coordinates_;
-	std::unordered_map<std::string, Cage> cages;
+	std::vector<Cage> cages;
+	std::unordered_map<std::string, CageId> cage_ids_;
+	CageIndex cage_index_;
+	EntityTable entities_;
 	GraphData graph_data_;
+	DiseaseTotals totals_;
+	CounterRandom random_;
+	SimulationParams params_;
+	int next_circle_id_{};
+	ThreadPool* thread_pool_ = nullptr;
+	MetricsExporter* metrics_exporter_ = nullptr;
+	// table of cage names at the exporter that the published records refer to, added again when the cages change
+	uint32_t metrics_cage_names_{};
+	bool metrics_cage_names_current_{};
+	std::vector<DiseaseTotals> partial_totals_;
 public:
 	Canvas(glm::vec2 top_left_corner, int height, int width) : coordinates_(top_left_corner, height, width) {}
 
-	void addCage(Cage cage) {
-		cages[cage.name] = cage;
+	CageId addCage(Cage cage) {
+		const CageId id = static_cast<CageId>(cages.size());
+		cage.id = id;
+		cage.random = random_;
+		cage.params = params_;
+		cage_ids_[cage.name] = id;
+		cages.push_back(std::move(cage));
+		number_of_cages_++;
+		metrics_cage_names_current_ = false;
+		rebuildCageIndex_();
+		return id;
+	}
+
+	std::vector<Cage>& getCages() {
+		return cages;
 	}
 
-	std::unordered_map<std::string, Cage>& getCages() {
+	const std::vector<Cage>& getCages() const {
 		return cages;
 	}
 
-	Cage& operator[] (std::string& name) {
-		return cages[std::string(name)];
+	Cage& operator[] (CageId id) {
+		return cages[id];
+	}
+
+	/**
+	 * Return id of the cage with the name or NO_CAGE if there is no such cage.
+	 **/
+	CageId findCageId(const std::string& name) const {
+		auto it = cage_ids_.find(name);
+		return it == cage_ids_.end() ? NO_CAGE : it->second;
+	}
+
+	/**
+	 * Return id of a cage that contains the point and is not the excluded one, or NO_CAGE.
+	 * If cages overlap, the one with the smallest id is returned.
+	 **/
+	CageId findCageAt(glm::vec2 point, CageId excluded = NO_CAGE) const {
+		CageId found = NO_CAGE;
+		cage_index_.forEachCandidate(point, [this, point, excluded, &found](CageId id) {
+			if (found == NO_CAGE && id != excluded && cages[id].surrounds(point)) {
+				found = id;
+			}
+		});
+		return found;
+	}
+
+	/**
+	 * Seed of all random numbers of the simulation. The same seed and the same actions give the same run.
+	 **/
+	void setSeed(uint64_t seed) {
+		random_ = CounterRandom(seed);
+		for (auto& cage : cages) {
+			cage.random = random_;
+			cage.redrawRecoveryTimes(thread_pool_);
+		}
+	}
+
+	const CounterRandom& getRandom() const {
+		return random_;
+	}
+
+	/**
+	 * Parameters of the disease and the movement, used from the next update on.
+	 * Throws std::invalid_argument if they are not valid.
+	 **/
+	void setParams(const SimulationParams& params) {
+		params.validate();
+		const bool recovery_time_changed = params.recovery_time_min != params_.recovery_time_min || params.recovery_time_max != params_.recovery_time_max;
+		params_ = params;
+		for (auto& cage : cages) {
+			cage.params = params_;
+			if (recovery_time_changed) {
+				cage.redrawRecoveryTimes(thread_pool_);
+			}
+		}
+	}
+
+	const SimulationParams& getParams() const {
+		return params_;
+	}
+
+	/**
+	 * Replace the circles of the cage with new ones. Every circle of the canvas gets its own id.
+	 **/
+	void repopulate(CageId id) {
+		CircleStorage& circles = cages[id].getCircles();
+		for (size_t i = 0; i < circles.size(); i++) {
+			entities_.destroy(circles.handle[i]);
+		}
+		cages[id].repopulate(next_circle_id_, thread_pool_);
+		next_circle_id_ += cages[id].getPopulationSize();
+		entities_.createRange(id, circles.size(), circles.handle.data());
+	}
+
+	/**
+	 * Give handles to circles that were put into the cages directly (a restored checkpoint),
+	 * continue circle ids after the biggest one and draw the recovery times of the susceptible circles.
+	 **/
+	void reindexCircles() {
+		entities_.clear();
+		next_circle_id_ = 0;
+		for (auto& cage : cages) {
+			CircleStorage& circles = cage.getCircles();
+			circles.handle.resize(circles.size());
+			for (size_t i = 0; i < circles.size(); i++) {
+				circles.handle[i] = entities_.create(EntityLocation{ cage.id, static_cast<uint32_t>(i) });
+				next_circle_id_ = std::max(next_circle_id_, circles.id[i] + 1);
+			}
+			cage.rescheduleStageChanges();
+			cage.redrawRecoveryTimes(thread_pool_);
+		}
+	}
+
+	/**
+	 * Move the circle to the destination cage and return its index there.
+	 * Only the row of the circle is moved; the handles of the circle and of the circle that takes its old index
+	 * are pointed to the new places.
+	 **/
+	size_t moveCircle(EntityHandle handle, CageId destination) {
+		const EntityLocation from = entities_.locate(handle);
+		Cage& source = cages[from.cage];
+		const size_t index = source.moveCircleTo(from.index, cages[destination]);
+		entities_.relocate(handle, EntityLocation{ destination, static_cast<uint32_t>(index) });
+		const CircleStorage& source_circles = source.getCircles();
+		if (from.index < source_circles.size()) {
+			entities_.relocate(source_circles.handle[from.index], from);
+		}
+		return index;
+	}
+
+	const EntityTable& getEntities() const {
+		return entities_;
+	}
+
+	void populateInfected(CageId id, int number_of_infected_to_populate, float time) {
+		cages[id].populateInfected(number_of_infected_to_populate, time);
+	}
+
+	/**
+	 * Cages are updated on the threads of the pool. Without a pool (nullptr) everything runs on the calling thread.
+	 **/
+	void setThreadPool(ThreadPool* thread_pool) {
+		thread_pool_ = thread_pool;
+	}
+
+	ThreadPool* getThreadPool() const {
+		return thread_pool_;
 	}
 
-	void populate(const char* name) {
-		cages[std::string(name)].populate();
+	/**
+	 * After every step the counts of every cage and of the whole canvas are published to the exporter (nullptr to stop).
+	 **/
+	void setMetricsExporter(MetricsExporter* metrics_exporter) {
+		metrics_exporter_ = metrics_exporter;
+		metrics_cage_names_current_ = false;
 	}
 
-	void populateInfected(const char* name, int number_of_infected_to_populate, float time) {
-		cages[std::string(name)].populateInfected(number_of_infected_to_populate, time);
+	/**
+	 * Number of threads that may run parallelForEachCage at the same time.
+	 **/
+	size_t concurrency() const {
+		return thread_pool_ ? thread_pool_->concurrency() : 1;
 	}
 
-	void update(float scaled_current_time) {
-		float susceptible_total = 0, infected_total = 0, recovered_total = 0, dead_total = 0;
-		for (auto& [name, cage] : cages) {
-			cage.update(scaled_current_time);
-			if (SIMULATION_SPEED) {
-				susceptible_total += cage.susceptible;
-				infected_total += cage.infected;
-				recovered_total += cage.recovered;
-				dead_total += cage.dead;
+	/**
+	 * Call function(cage, worker) for every cage, in parallel if there is a thread pool.
+	 * worker is less than concurrency() and no two threads use the same worker at the same time.
+	 **/
+	template <typename Function>
+	void parallelForEachCage(Function function) {
+		if (!thread_pool_) {
+			for (auto& cage : cages) {
+				function(cage, 0);
 			}
+			return;
+		}
+		thread_pool_->parallelFor(cages.size(), [this, &function](size_t i, size_t worker) { function(cages[i], worker); });
+	}
+
+	void update(const SimulationClock& clock) {
+		PROFILE_SCOPE("Canvas::update");
+		const auto start = std::chrono::steady_clock::now();
+		partial_totals_.assign(concurrency(), DiseaseTotals());
+		parallelForEachCage([this, &clock](Cage& cage, size_t worker) {
+			cage.update(clock, entities_, thread_pool_);
+			DiseaseTotals& partial = partial_totals_[worker];
+			partial.susceptible += cage.susceptible;
+			partial.infected += cage.infected;
+			partial.recovered += cage.recovered;
+			partial.dead += cage.dead;
+		});
+		DiseaseTotals totals;
+		for (const auto& partial : partial_totals_) {
+			totals.susceptible += partial.susceptible;
+			totals.infected += partial.infected;
+			totals.recovered += partial.recovered;
+			totals.dead += partial.dead;
 		}
-		if (SIMULATION_SPEED)
-			graph_data_.update(susceptible_total, infected_total, recovered_total, dead_total, scaled_current_time);
+		totals_ = totals;
+		graph_data_.update(totals.susceptible, totals.infected, totals.recovered, totals.dead, clock.current_time);
+		if (metrics_exporter_) {
+			const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+			publishMetrics_(clock, duration.count());
+		}
+	}
+
+	/**
+	 * Sum of the disease stages over all cages after the last update.
+	 **/
+	const DiseaseTotals& getTotals() const {
+		return totals_;
 	}
 
 	GraphData& getGraphData() {
 		return graph_data_;
 	}
 
+	const GraphData& getGraphData() const {
+		return graph_data_;
+	}
+
 	bool isCoordinatesValid(int* left_corner, int* size) {
 		if (left_corner[0] <= 0 || left_corner[1] <= 0 || size[0] <= 0 || size[1] <= 0 || size[0] + left_corner[0] > VIEWPORT_WIDTH || size[1] + left_corner[1] > VIEWPORT_HEIGHT) {
 			return false;
@@ -61,8 +272,7 @@ public:
 	}
 
 	bool isOverlapCages(int* left_corner, int* size) {
-		for (const auto& [cage_name, cage] : cages) {
-			auto cage_coordinates = cage.getCoordinates();
+		for (const auto& cage : cages) {
 			if (isOverlap(
 				cage.getCoordinates(),
 				Coordinates(
@@ -76,44 +286,40 @@ public:
 		return true;
 	}
 	
-	void drawCircles(ImDrawList* drawList) {
-		for (auto& [name, cage] : cages) {
-			for (Circle& circle : cage.getCircles()) {
-				ImVec2 center = ImVec2(circle.center.x, circle.center.y);
-				ImColor color = switchColorByDiseaseStage(circle.disease_stage);
-				drawList->AddCircleFilled(center, circle.radius, color);
-			}
-		}
+	bool isCageNameRepeats(char* cage_name) {
+		return findCageId(cage_name) == NO_CAGE;
 	}
 
-	void drawCages(ImDrawList* drawList) {
-		for (const auto& [name, cage] : cages) {
-			const auto cage_coordinates = cage.getCoordinates();
-			ImVec2 left = ImVec2(cage_coordinates.top_left_corner.x - 1, cage_coordinates.top_left_corner.y - 1);
-			ImVec2 right = ImVec2(left.x + cage_coordinates.width + 3, left.y + cage_coordinates.height + 3);
-			drawList->AddRect(left, right, BORDER_COLOR, 1, ImDrawFlags(), 2);
-			drawList->AddText(
-				ImGui::GetFont(),
-				CAGE_FONT_SIZE,
-				ImVec2(left.x + cage_coordinates.width / 2. - CAGE_FONT_SIZE / 2. * cage.name.length() / 2., left.y - 25),
-				CAGE_NAME_COLOR, 
-				cage.name.c_str()
-			);
-		}
+	void clear_data() {
+		cages.clear();
+		cage_ids_.clear();
+		rebuildCageIndex_();
+		entities_.clear();
+		next_circle_id_ = 0;
+		number_of_cages_ = 0;
+		metrics_cage_names_current_ = false;
+		graph_data_.clearGraphData();
+		totals_ = DiseaseTotals();
 	}
 
-	bool isCageNameRepeats(char* cage_name) {
-		for (auto& [name, cage] : cages) {
-			if (name == std::string(cage_name)) {
-				return false;
+private:
+	void publishMetrics_(const SimulationClock& clock, float update_milliseconds) {
+		if (!metrics_cage_names_current_) {
+			std::vector<std::string> names;
+			names.reserve(cages.size());
+			for (const auto& cage : cages) {
+				names.push_back(cage.name);
 			}
+			metrics_cage_names_ = metrics_exporter_->addCageNames(std::move(names));
+			metrics_cage_names_current_ = true;
 		}
-		return true;
+		for (const auto& cage : cages) {
+			metrics_exporter_->publish(MetricsRecord{ clock.step, clock.current_time, cage.id, metrics_cage_names_, cage.susceptible, cage.infected, cage.recovered, cage.dead, 0 });
+		}
+		metrics_exporter_->publish(MetricsRecord{ clock.step, clock.current_time, NO_CAGE, metrics_cage_names_, totals_.susceptible, totals_.infected, totals_.recovered, totals_.dead, update_milliseconds });
 	}
 
-	void clear_data() {
-		cages.clear();
-		number_of_cages_ = 0;
-		graph_data_.clearGraphData();
+	void rebuildCageIndex_() {
+		cage_index_.build(cages.size(), [this](CageId id) { return cages[id].getCoordinates(); });
 	}
 };
@@ -0,0 +1,137 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "imgui.h"
+
+#include "canvas_snapshot.h"
+#include "profiler.h"
+#include "ui_settings.h"
+
+ImColor switchColorByDiseaseStage(DiseaseStages disease_stage) {
+	switch (disease_stage) {
+	case DiseaseStages::SUSCEPTIBLE:
+		return SUSCEPTIBLE_COLOR;
+	case DiseaseStages::INFECTED:
+		return INFECTED_COLOR;
+	case DiseaseStages::RECOVERED:
+		return RECOVERED_COLOR;
+	case DiseaseStages::DEAD:
+		return DEAD_COLOR;
+	}
+	return SUSCEPTIBLE_COLOR;
+}
+
+/**
+ *	Draw cages and circles of the Canvas into an ImGui draw list.
+ *	The Canvas itself knows nothing about rendering, so it can run without a window; what is drawn is a snapshot of it.
+ **/
+class CanvasRenderer {
+	static constexpr int CIRCLE_SEGMENTS = 8;
+	static constexpr int CIRCLE_VERTICES = CIRCLE_SEGMENTS + 1;
+	static constexpr int CIRCLE_INDICES = CIRCLE_SEGMENTS * 3;
+	// Vertices of one batch are addressed by 16 bit indices.
+	static constexpr size_t CIRCLES_PER_BATCH = 65535 / CIRCLE_VERTICES;
+	static constexpr size_t CELLS_PER_BATCH = 65535 / 4;
+
+	std::array<ImVec2, CIRCLE_SEGMENTS> circle_outline_;
+	std::array<ImU32, 4> stage_colors_;
+	std::array<ImVec4, 4> stage_color_values_;
+
+public:
+	CanvasRenderer() {
+		for (int k = 0; k < CIRCLE_SEGMENTS; k++) {
+			const float angle = 2.f * 3.14159265f * k / CIRCLE_SEGMENTS;
+			circle_outline_[k] = ImVec2(std::cos(angle) * CIRCLE_RADIUS, std::sin(angle) * CIRCLE_RADIUS);
+		}
+		for (auto stage : { DiseaseStages::SUSCEPTIBLE, DiseaseStages::INFECTED, DiseaseStages::RECOVERED, DiseaseStages::DEAD }) {
+			stage_colors_[static_cast<size_t>(stage)] = switchColorByDiseaseStage(stage);
+			stage_color_values_[static_cast<size_t>(stage)] = switchColorByDiseaseStage(stage).Value;
+		}
+	}
+
+	/**
+	 * Circles are written straight into the vertex and index buffers of the draw list, a batch of circles at a time,
+	 * as triangle fans built from a precomputed outline.
+	 */
+	void drawCircles(ImDrawList* drawList, const CanvasSnapshot& snapshot) {
+		PROFILE_SCOPE("CanvasRenderer::drawCircles");
+		const ImVec2 uv = ImGui::GetFontTexUvWhitePixel();
+		for (size_t begin = 0; begin < snapshot.size(); begin += CIRCLES_PER_BATCH) {
+			const size_t end = std::min(snapshot.size(), begin + CIRCLES_PER_BATCH);
+			const int count = static_cast<int>(end - begin);
+			drawList->PrimReserve(count * CIRCLE_INDICES, count * CIRCLE_VERTICES);
+			for (size_t i = begin; i < end; i++) {
+				const ImDrawIdx center_index = static_cast<ImDrawIdx>(drawList->_VtxCurrentIdx);
+				const ImU32 color = stage_colors_[static_cast<size_t>(snapshot.stage[i])];
+				const float x = snapshot.x[i], y = snapshot.y[i];
+				drawList->PrimWriteVtx(ImVec2(x, y), uv, color);
+				for (const ImVec2& offset : circle_outline_) {
+					drawList->PrimWriteVtx(ImVec2(x + offset.x, y + offset.y), uv, color);
+				}
+				for (int k = 0; k < CIRCLE_SEGMENTS; k++) {
+					drawList->PrimWriteIdx(center_index);
+					drawList->PrimWriteIdx(static_cast<ImDrawIdx>(center_index + 1 + k));
+					drawList->PrimWriteIdx(static_cast<ImDrawIdx>(center_index + 1 + (k + 1) % CIRCLE_SEGMENTS));
+				}
+			}
+		}
+	}
+
+	/**
+	 * Every non-empty cell of the cages drawn as heatmaps is a square in the mean color of its circles' stages,
+	 * opaque when the circles could cover it.
+	 */
+	void drawHeatmaps(ImDrawList* drawList, const CanvasSnapshot& snapshot) {
+		PROFILE_SCOPE("CanvasRenderer::drawHeatmaps");
+		const float circle_area = 3.14159265f * CIRCLE_RADIUS * CIRCLE_RADIUS;
+		for (const auto& cage : snapshot.cages) {
+			if (!cage.heatmap) continue;
+			const float cell_size = cage.heatmap_cell_size;
+			const size_t cell_count = static_cast<size_t>(cage.heatmap_columns) * cage.heatmap_rows;
+			const auto* cells = snapshot.heatmap.data() + cage.heatmap_begin;
+			size_t reserved = 0;
+			for (size_t k = 0; k < cell_count; k++) {
+				const auto& counts = cells[k];
+				const uint32_t total = counts[0] + counts[1] + counts[2] + counts[3];
+				if (total == 0) continue;
+				ImVec4 color(0, 0, 0, 0);
+				for (size_t s = 0; s < counts.size(); s++) {
+					const float share = static_cast<float>(counts[s]) / total;
+					color.x += stage_color_values_[s].x * share;
+					color.y += stage_color_values_[s].y * share;
+					color.z += stage_color_values_[s].z * share;
+				}
+				color.w = std::min(1.f, total * circle_area / (cell_size * cell_size));
+				if (reserved == 0) {
+					reserved = CELLS_PER_BATCH;
+					drawList->PrimReserve(static_cast<int>(reserved * 6), static_cast<int>(reserved * 4));
+				}
+				const ImVec2 top_left(cage.heatmap_origin.x + (k % cage.heatmap_columns) * cell_size, cage.heatmap_origin.y + (k / cage.heatmap_columns) * cell_size);
+				drawList->PrimRect(top_left, ImVec2(top_left.x + cell_size, top_left.y + cell_size), ImGui::ColorConvertFloat4ToU32(color));
+				reserved--;
+			}
+			if (reserved > 0) {
+				drawList->PrimUnreserve(static_cast<int>(reserved * 6), static_cast<int>(reserved * 4));
+			}
+		}
+	}
+
+	void drawCages(ImDrawList* drawList, const CanvasSnapshot& snapshot) {
+		PROFILE_SCOPE("CanvasRenderer::drawCages");
+		for (const auto& cage : snapshot.cages) {
+			const auto cage_coordinates = cage.coordinates;
+			ImVec2 left = ImVec2(cage_coordinates.top_left_corner.x - 1, cage_coordinates.top_left_corner.y - 1);
+			ImVec2 right = ImVec2(left.x + cage_coordinates.width + 3, left.y + cage_coordinates.height + 3);
+			drawList->AddRect(left, right, BORDER_COLOR, 1, ImDrawFlags(), 2);
+			drawList->AddText(
+				ImGui::GetFont(),
+				CAGE_FONT_SIZE,
+				ImVec2(left.x + cage_coordinates.width / 2. - CAGE_FONT_SIZE / 2. * cage.name.length() / 2., left.y - 25),
+				CAGE_NAME_COLOR,
+				cage.name.c_str()
+			);
+		}
+	}
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "canvas.h"
+#include "circle.h"
+#include "settings.h"
+#include "simulation_clock.h"
+#include "simulation_params.h"
+#include "spatial_grid.h"
+#include "util.h"
+
+/**
+ *	What the window needs to show a moment of the simulation: positions and stages of all circles, cages, totals,
+ *	the graph and the parameters.
+ *	The simulation thread captures it and the render thread draws it, so drawing never reads the Canvas.
+ *	A cage with at least the given number of circles (HEATMAP_MIN_CAGE_POPULATION in the window) is captured as the number of circles of every stage
+ *	in each cell of its spatial grid instead, so the cost of drawing it depends on its area and not on its population.
+ *	Circles that are on the way to another cage are outside of the grid and are kept as circles.
+ **/
+struct CanvasSnapshot {
+	struct CageOutline {
+		Coordinates coordinates;
+		std::string name;
+		// heatmap cells of the cage are heatmap[heatmap_begin ..], heatmap_columns * heatmap_rows of them, row by row
+		bool heatmap = false;
+		size_t heatmap_begin{};
+		int heatmap_columns{};
+		int heatmap_rows{};
+		glm::vec2 heatmap_origin{};
+		float heatmap_cell_size{};
+	};
+
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<DiseaseStages> stage;
+	// points of the graph, about two per pixel of a wide plot
+	static constexpr size_t GRAPH_POINTS = 2048;
+
+	std::vector<CageOutline> cages;
+	// circles of every stage in a cell
+	std::vector<std::array<uint32_t, 4>> heatmap;
+	GraphData::View graph;
+	bool continue_drawing = true;
+	SimulationParams params;
+	DiseaseTotals totals;
+	float time{};
+	uint64_t step{};
+	float steps_per_second{};
+
+	/**
+	 * The arrays keep their memory, so capturing the same canvas again allocates nothing.
+	 * Cages with at least heatmap_min_cage_population circles are captured as heatmaps.
+	 **/
+	void capture(const Canvas& canvas, const SimulationClock& clock, int heatmap_min_cage_population) {
+		x.clear();
+		y.clear();
+		stage.clear();
+		heatmap.clear();
+		cages.resize(canvas.getCages().size());
+		for (size_t c = 0; c < cages.size(); c++) {
+			const Cage& cage = canvas.getCages()[c];
+			const CircleStorage& circles = cage.getCircles();
+			cages[c].coordinates = cage.getCoordinates();
+			cages[c].name = cage.name;
+			cages[c].heatmap = circles.size() >= static_cast<size_t>(std::max(1, heatmap_min_cage_population));
+			if (cages[c].heatmap) {
+				captureHeatmap_(cage, cages[c]);
+			} else {
+				x.insert(x.end(), circles.x.begin(), circles.x.end());
+				y.insert(y.end(), circles.y.begin(), circles.y.end());
+				stage.insert(stage.end(), circles.stage.begin(), circles.stage.end());
+			}
+		}
+		canvas.getGraphData().view(GRAPH_POINTS, graph);
+		continue_drawing = canvas.getGraphData().continue_drawing;
+		params = canvas.getParams();
+		totals = canvas.getTotals();
+		time = clock.current_time;
+		step = clock.step;
+	}
+
+	size_t size() const {
+		return x.size();
+	}
+
+private:
+	/**
+	 * The grid is the one the cage built for the infections of its last update. If the rows changed since then
+	 * (a cage that has just been populated, circles that moved between cages), their cells are found from their positions.
+	 * The counts are taken anew on every capture.
+	 **/
+	void captureHeatmap_(const Cage& cage, CageOutline& outline) {
+		const SpatialGrid& grid = cage.getGrid();
+		const CircleStorage& circles = cage.getCircles();
+		outline.heatmap_begin = heatmap.size();
+		outline.heatmap_columns = grid.columns();
+		outline.heatmap_rows = grid.rows();
+		outline.heatmap_origin = grid.origin();
+		outline.heatmap_cell_size = grid.cellSize();
+		heatmap.resize(heatmap.size() + grid.cellCount(), std::array<uint32_t, 4>{});
+		std::array<uint32_t, 4>* cells = heatmap.data() + outline.heatmap_begin;
+		const bool grid_is_current = cage.isGridCurrent();
+		for (size_t i = 0; i < circles.size(); i++) {
+			if (circles.moving_state[i] != CircleMovingState::RESTING && !cage.surrounds(circles.center(i))) {
+				x.push_back(circles.x[i]);
+				y.push_back(circles.y[i]);
+				stage.push_back(circles.stage[i]);
+				continue;
+			}
+			const int cell = grid_is_current ? grid.itemCell(i) : grid.cellIndex(circles.center(i));
+			cells[cell][static_cast<size_t>(circles.stage[i])]++;
+		}
+	}
+};
@@ -0,0 +1,254 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cage_mediator.h"
+#include "canvas.h"
+#include "mapped_file.h"
+#include "simulation_clock.h"
+
+const std::string CHECKPOINT_EXTENSION = ".ckpt";
+
+/**
+ *	Binary snapshot of the whole simulation: the clock, the seed, the parameters, every cage with all data of its circles, and the flows.
+ *	A restored simulation continues exactly as the saved one would have.
+ *
+ *	The file starts with a magic string, a format version and a byte order mark; circle data is stored column by column
+ *	in the layout of CircleStorage, so restoring is a copy of each column out of the memory-mapped file.
+ *	Handles are not stored, they are given anew on restore.
+ **/
+class Checkpoint {
+	static constexpr char MAGIC[8] = { 'C', 'O', 'V', 'I', 'D', 'C', 'K', 'P' };
+	static constexpr uint32_t VERSION = 1;
+	static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+	class Writer {
+		std::ofstream out_;
+	public:
+		explicit Writer(const std::string& path) : out_(path, std::ios::binary | std::ios::trunc) {
+			if (!out_) {
+				throw std::runtime_error("Could not create " + path);
+			}
+		}
+
+		template <typename T>
+		void value(const T& value) {
+			out_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template <typename T>
+		void array(const std::vector<T>& array) {
+			out_.write(reinterpret_cast<const char*>(array.data()), static_cast<std::streamsize>(array.size() * sizeof(T)));
+		}
+
+		void string(const std::string& string) {
+			value(static_cast<uint32_t>(string.size()));
+			out_.write(string.data(), static_cast<std::streamsize>(string.size()));
+		}
+
+		void close() {
+			out_.close();
+			if (!out_) {
+				throw std::runtime_error("Could not write the checkpoint");
+			}
+		}
+	};
+
+	class Reader {
+		const unsigned char* data_;
+		size_t size_;
+		size_t offset_{};
+	public:
+		Reader(const unsigned char* data, size_t size) : data_(data), size_(size) {}
+
+		template <typename T>
+		T value() {
+			T value;
+			std::memcpy(&value, take_(sizeof(T)), sizeof(T));
+			return value;
+		}
+
+		template <typename T>
+		void array(std::vector<T>& array, size_t count) {
+			if (count > size_ / sizeof(T)) {
+				throw std::runtime_error("Checkpoint is truncated");
+			}
+			array.resize(count);
+			std::memcpy(array.data(), take_(count * sizeof(T)), count * sizeof(T));
+		}
+
+		std::string string() {
+			const uint32_t length = value<uint32_t>();
+			return std::string(reinterpret_cast<const char*>(take_(length)), length);
+		}
+
+	private:
+		const unsigned char* take_(size_t bytes) {
+			if (bytes > size_ - offset_) {
+				throw std::runtime_error("Checkpoint is truncated");
+			}
+			const unsigned char* data = data_ + offset_;
+			offset_ += bytes;
+			return data;
+		}
+	};
+
+public:
+	static void save(const std::string& path, const Canvas& canvas, const CageMediator& cage_mediator, const SimulationClock& clock) {
+		// a crash while writing must not destroy the previous checkpoint
+		const std::string temporary_path = path + ".tmp";
+		{
+			Writer out(temporary_path);
+			out.value(MAGIC);
+			out.value(VERSION);
+			out.value(BYTE_ORDER_MARK);
+			out.value(canvas.getRandom().seed());
+			for (const auto& field : SimulationParams::fields()) {
+				out.value(canvas.getParams().*field.value);
+			}
+			out.value(clock.current_time);
+			out.value(clock.step);
+
+			const auto& cages = canvas.getCages();
+			out.value(static_cast<uint32_t>(cages.size()));
+			for (const auto& cage : cages) {
+				const Coordinates coordinates = cage.getCoordinates();
+				out.string(cage.name);
+				out.value(coordinates.top_left_corner.x);
+				out.value(coordinates.top_left_corner.y);
+				out.value(static_cast<int32_t>(coordinates.width));
+				out.value(static_cast<int32_t>(coordinates.height));
+				out.value(static_cast<int32_t>(cage.getPopulationSize()));
+				out.value(static_cast<int32_t>(cage.susceptible));
+				out.value(static_cast<int32_t>(cage.infected));
+				out.value(static_cast<int32_t>(cage.recovered));
+				out.value(static_cast<int32_t>(cage.dead));
+				out.value(cage.getLastUpdateTime());
+
+				const CircleStorage& circles = cage.getCircles();
+				out.value(static_cast<uint64_t>(circles.size()));
+				forEachColumn_(circles, [&out](const auto& column) { out.array(column); });
+			}
+
+			const auto& flows = cage_mediator.getFlows();
+			out.value(static_cast<uint32_t>(flows.size()));
+			for (const auto& flow : flows) {
+				out.value(static_cast<int32_t>(flow.source));
+				out.value(static_cast<int32_t>(flow.destination));
+				out.value(static_cast<int32_t>(flow.amount));
+			}
+			out.close();
+		}
+		std::filesystem::rename(temporary_path, path);
+	}
+
+	/**
+	 * Replace the state of the canvas, the mediator and the clock with the checkpoint.
+	 * Throws std::runtime_error if the file is not a checkpoint of this version or is damaged.
+	 **/
+	static void restore(const std::string& path, Canvas& canvas, CageMediator& cage_mediator, SimulationClock& clock) {
+		MappedFile file(path);
+		Reader in(file.data(), file.size());
+
+		char magic[sizeof(MAGIC)];
+		for (auto& c : magic) {
+			c = in.value<char>();
+		}
+		if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+			throw std::runtime_error(path + " is not a checkpoint");
+		}
+		const uint32_t version = in.value<uint32_t>();
+		if (version != VERSION) {
+			throw std::runtime_error(path + " is a checkpoint of another version");
+		}
+		if (in.value<uint32_t>() != BYTE_ORDER_MARK) {
+			throw std::runtime_error(path + " was written on a machine with another byte order");
+		}
+
+		// the whole file is read and checked before the live state is touched, so a damaged file changes nothing
+		const uint64_t seed = in.value<uint64_t>();
+		SimulationParams params;
+		for (const auto& field : SimulationParams::fields()) {
+			params.*field.value = in.value<float>();
+		}
+		try {
+			params.validate();
+		} catch (const std::invalid_argument&) {
+			throw std::runtime_error(path + " is damaged: the parameters are not valid");
+		}
+		SimulationClock restored_clock;
+		restored_clock.current_time = in.value<float>();
+		restored_clock.step = in.value<uint64_t>();
+
+		const uint32_t cage_count = in.value<uint32_t>();
+		std::vector<Cage> cages;
+		for (uint32_t k = 0; k < cage_count; k++) {
+			std::string name = in.string();
+			Coordinates coordinates;
+			coordinates.top_left_corner.x = in.value<float>();
+			coordinates.top_left_corner.y = in.value<float>();
+			coordinates.width = in.value<int32_t>();
+			coordinates.height = in.value<int32_t>();
+			const int population_size = in.value<int32_t>();
+
+			cages.emplace_back(population_size, coordinates, name);
+			Cage& cage = cages.back();
+			cage.susceptible = in.value<int32_t>();
+			cage.infected = in.value<int32_t>();
+			cage.recovered = in.value<int32_t>();
+			cage.dead = in.value<int32_t>();
+			cage.setLastUpdateTime(in.value<float>());
+
+			CircleStorage& circles = cage.getCircles();
+			const size_t circle_count = static_cast<size_t>(in.value<uint64_t>());
+			forEachColumn_(circles, [&in, circle_count](auto& column) { in.array(column, circle_count); });
+			for (size_t i = 0; i < circle_count; i++) {
+				if (!isCageOrNone_(circles.home_cage[i], cage_count) || !isCageOrNone_(circles.destination_cage[i], cage_count) || !isCageOrNone_(circles.current_cage[i], cage_count)) {
+					throw std::runtime_error(path + " is damaged: a circle refers to an unknown cage");
+				}
+				if (circles.stage[i] > DiseaseStages::DEAD || circles.moving_state[i] > CircleMovingState::MOVING_TO_DESTINATION_CAGE) {
+					throw std::runtime_error(path + " is damaged: a circle has an unknown state");
+				}
+			}
+		}
+
+		std::vector<Flow> flows(in.value<uint32_t>());
+		for (auto& flow : flows) {
+			flow.source = in.value<int32_t>();
+			flow.destination = in.value<int32_t>();
+			flow.amount = in.value<int32_t>();
+			if (flow.source == NO_CAGE || flow.destination == NO_CAGE || !isCageOrNone_(flow.source, cage_count) || !isCageOrNone_(flow.destination, cage_count)) {
+				throw std::runtime_error(path + " is damaged: a flow refers to an unknown cage");
+			}
+		}
+
+		cage_mediator.clearData();
+		canvas.setSeed(seed);
+		canvas.setParams(params);
+		for (auto& cage : cages) {
+			canvas.addCage(std::move(cage));
+		}
+		cage_mediator.restoreFlows(std::move(flows));
+		canvas.reindexCircles();
+		cage_mediator.rescheduleDepartures();
+		clock = restored_clock;
+	}
+
+private:
+	template <typename Storage, typename Function>
+	static void forEachColumn_(Storage& circles, Function function) {
+		function(circles.x); function(circles.y); function(circles.dx); function(circles.dy); function(circles.stage);
+		function(circles.id); function(circles.moving_state); function(circles.disease_stage_change_time);
+		function(circles.recovery_time); function(circles.arrived_in);
+		function(circles.home_cage); function(circles.destination_cage); function(circles.current_cage);
+	}
+
+	static bool isCageOrNone_(CageId id, uint32_t cage_count) {
+		return id >= NO_CAGE && id < static_cast<CageId>(cage_count);
+	}
+};
@@ -1,55 +1,177 @@
 #pragma once
+#include <cstdint>
+#include <vector>
 #include <glm/vec2.hpp>
 
 #include "settings.h"
 
-enum class DiseaseStages {
+/**
+ *	Index of a cage in the Canvas. Names of cages are used only by the UI and in the save files.
+ **/
+using CageId = int;
+
+constexpr CageId NO_CAGE = -1;
+
+/**
+ *	Stable reference to a circle (see EntityTable). A circle keeps its handle when it moves between cages,
+ *	the generation tells a handle of a removed circle from a handle of a circle that reuses its slot.
+ **/
+struct EntityHandle {
+	static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+	uint32_t index = INVALID_INDEX;
+	uint32_t generation{};
+
+	bool operator==(const EntityHandle& rhs) const {
+		return index == rhs.index && generation == rhs.generation;
+	}
+
+	bool operator!=(const EntityHandle& rhs) const {
+		return !(*this == rhs);
+	}
+};
+
+enum class DiseaseStages : uint8_t {
 	SUSCEPTIBLE, INFECTED, RECOVERED, DEAD
 };
 
-enum class CircleMovingState {
+enum class CircleMovingState : uint8_t {
 	RESTING, MOVING_TO_HOME_CAGE, MOVING_TO_DESTINATION_CAGE
 };
 
+/**
+ *	A single circle.
+ *	Circles are not stored like this (see CircleStorage), the struct is only used to pass one circle around.
+ **/
 struct Circle {
 	glm::vec2 center = glm::vec2(10.f, 10.f);
 	glm::vec2 direction = glm::vec2(0.f, 0.f);
-	float radius = 3.f;
 
-	int id;
+	int id{};
+	EntityHandle handle{};
 	CircleMovingState circle_moving_state = CircleMovingState::RESTING;
 	DiseaseStages disease_stage = DiseaseStages::SUSCEPTIBLE;
 	float disease_stage_change_time = 0;
-	std::string home_cage;
-	std::string destination_cage;
-	std::string current_cage;
-	float arrived_in;
-	float recovery_time;
-
-	Circle() {
-		static int id_ = 0;
-		id = ++id_;
-	}
+	CageId home_cage = NO_CAGE;
+	CageId destination_cage = NO_CAGE;
+	CageId current_cage = NO_CAGE;
+	float arrived_in = -1;
+	float recovery_time = 0;
 
 	bool operator==(const Circle& rhs) const {
 		return rhs.id == id;
 	}
 };
 
-bool intersect(const Circle& c1, const Circle& c2) {
-	glm::vec2 diff = c2.center - c1.center;
-	return diff.x * diff.x + diff.y * diff.y <= 4 * c1.radius * c1.radius;
-}
-
-ImColor switchColorByDiseaseStage(DiseaseStages disease_stage) {
-	switch (disease_stage) {
-	case DiseaseStages::SUSCEPTIBLE:
-		return SUSCEPTIBLE_COLOR;
-	case DiseaseStages::INFECTED:
-		return INFECTED_COLOR;
-	case DiseaseStages::RECOVERED:
-		return RECOVERED_COLOR;
-	case DiseaseStages::DEAD:
-		return DEAD_COLOR;
-	}
-}
\ No newline at end of file
+/**
+ *	Circles of a cage stored as a structure of arrays.
+ *	Hot data that is read on every update (position, direction and disease stage) lives in its own contiguous arrays,
+ *	cold data that is only needed on disease stage changes and by the CageMediator is kept in separate arrays.
+ *	Order of circles is not stable: removal moves the last circle into the freed place.
+ **/
+struct CircleStorage {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> dx;
+	std::vector<float> dy;
+	std::vector<DiseaseStages> stage;
+
+	std::vector<int> id;
+	std::vector<EntityHandle> handle;
+	std::vector<CircleMovingState> moving_state;
+	std::vector<float> disease_stage_change_time;
+	std::vector<float> recovery_time;
+	std::vector<float> arrived_in;
+	std::vector<CageId> home_cage;
+	std::vector<CageId> destination_cage;
+	std::vector<CageId> current_cage;
+
+	size_t size() const {
+		return x.size();
+	}
+
+	void reserve(size_t capacity) {
+		forEachArray_([capacity](auto& array) { array.reserve(capacity); });
+	}
+
+	void clear() {
+		forEachArray_([](auto& array) { array.clear(); });
+	}
+
+	void resize(size_t size) {
+		forEachArray_([size](auto& array) { array.resize(size); });
+	}
+
+	size_t push_back(const Circle& circle) {
+		x.push_back(circle.center.x);
+		y.push_back(circle.center.y);
+		dx.push_back(circle.direction.x);
+		dy.push_back(circle.direction.y);
+		stage.push_back(circle.disease_stage);
+		id.push_back(circle.id);
+		handle.push_back(circle.handle);
+		moving_state.push_back(circle.circle_moving_state);
+		disease_stage_change_time.push_back(circle.disease_stage_change_time);
+		recovery_time.push_back(circle.recovery_time);
+		arrived_in.push_back(circle.arrived_in);
+		home_cage.push_back(circle.home_cage);
+		destination_cage.push_back(circle.destination_cage);
+		current_cage.push_back(circle.current_cage);
+		return size() - 1;
+	}
+
+	Circle get(size_t i) const {
+		Circle circle;
+		circle.center = center(i);
+		circle.direction = glm::vec2(dx[i], dy[i]);
+		circle.disease_stage = stage[i];
+		circle.id = id[i];
+		circle.handle = handle[i];
+		circle.circle_moving_state = moving_state[i];
+		circle.disease_stage_change_time = disease_stage_change_time[i];
+		circle.recovery_time = recovery_time[i];
+		circle.arrived_in = arrived_in[i];
+		circle.home_cage = home_cage[i];
+		circle.destination_cage = destination_cage[i];
+		circle.current_cage = current_cage[i];
+		return circle;
+	}
+
+	glm::vec2 center(size_t i) const {
+		return glm::vec2(x[i], y[i]);
+	}
+
+	void swapRemove(size_t i) {
+		forEachArray_([i](auto& array) {
+			array[i] = std::move(array.back());
+			array.pop_back();
+		});
+	}
+
+	/**
+	 * Append the circle i to the destination and swap-remove it here. Returns its index in the destination.
+	 **/
+	size_t moveTo(size_t i, CircleStorage& destination) {
+		forEachArrayPair_(*this, destination, [i](auto& from, auto& to) {
+			to.push_back(from[i]);
+			from[i] = std::move(from.back());
+			from.pop_back();
+		});
+		return destination.size() - 1;
+	}
+
+private:
+	template <typename Function>
+	void forEachArray_(Function function) {
+		forEachArrayPair_(*this, *this, [&function](auto& array, auto&) { function(array); });
+	}
+
+	template <typename Function>
+	static void forEachArrayPair_(CircleStorage& a, CircleStorage& b, Function function) {
+		function(a.x, b.x); function(a.y, b.y); function(a.dx, b.dx); function(a.dy, b.dy); function(a.stage, b.stage);
+		function(a.id, b.id); function(a.handle, b.handle); function(a.moving_state, b.moving_state);
+		function(a.disease_stage_change_time, b.disease_stage_change_time); function(a.recovery_time, b.recovery_time);
+		function(a.arrived_in, b.arrived_in); function(a.home_cage, b.home_cage);
+		function(a.destination_cage, b.destination_cage); function(a.current_cage, b.current_cage);
+	}
+};
\ No newline at end of file
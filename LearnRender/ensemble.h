@@ -0,0 +1,227 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cage_mediator.h"
+#include "canvas.h"
+#include "simulation_clock.h"
+#include "simulation_params.h"
+#include "simulation_stepper.h"
+#include "thread_pool.h"
+
+struct EnsembleOptions {
+	std::string save_file;
+	SimulationParams params;
+	// cage name and number of circles to infect before the run
+	std::vector<std::pair<std::string, int>> infected;
+	size_t replicas = 100;
+	uint64_t first_seed{};
+	uint64_t steps = 1000;
+	float step_duration = 1.f;
+	uint64_t record_every = 1;
+};
+
+/**
+ *	Quantiles of the susceptible, infected, recovered and dead numbers over the replicas after one step.
+ **/
+struct EnsembleRow {
+	uint64_t step{};
+	float time{};
+	std::array<float, 4> low{};
+	std::array<float, 4> median{};
+	std::array<float, 4> high{};
+};
+
+/**
+ *	Runs independent replicas of a save file, replica r with the seed first_seed + r.
+ *	Replicas advance together one step at a time, all of them in parallel on the thread pool, and after a step
+ *	the exact quantiles of their numbers are taken, so the result is the same for any number of threads
+ *	and the trajectories of the replicas are never stored.
+ **/
+class EnsembleRunner {
+public:
+	static constexpr double LOW_QUANTILE = 0.05;
+	static constexpr double HIGH_QUANTILE = 0.95;
+
+private:
+	struct Replica {
+		Canvas canvas;
+		CageMediator cage_mediator;
+		SimulationClock clock;
+
+		Replica() : canvas(glm::vec2(0, 0), VIEWPORT_HEIGHT, VIEWPORT_WIDTH), cage_mediator(&canvas) {}
+	};
+
+	EnsembleOptions options_;
+
+public:
+	explicit EnsembleRunner(EnsembleOptions options) : options_(std::move(options)) {
+		if (options_.replicas == 0 || options_.record_every == 0 || options_.step_duration <= 0) {
+			throw std::invalid_argument("Ensemble needs at least one replica, a positive step and a positive record interval");
+		}
+		options_.params.validate();
+	}
+
+	/**
+	 * on_row is called on the calling thread after every recorded step. The run stops early if cancel becomes true.
+	 **/
+	std::vector<EnsembleRow> run(ThreadPool& pool, const std::function<void(const EnsembleRow&)>& on_row = {}, const std::atomic<bool>* cancel = nullptr) {
+		std::vector<std::unique_ptr<Replica>> replicas(options_.replicas);
+		pool.parallelFor(replicas.size(), [this, &replicas, &pool](size_t r, size_t) {
+			auto replica = std::make_unique<Replica>();
+			replica->canvas.setSeed(options_.first_seed + r);
+			replica->canvas.setParams(options_.params);
+			replica->canvas.setThreadPool(&pool);
+			replica->canvas.getGraphData().continue_drawing = false;
+			replica->cage_mediator.load(options_.save_file);
+			for (const auto& [cage_name, number_of_infected] : options_.infected) {
+				const CageId cage_id = replica->canvas.findCageId(cage_name);
+				if (cage_id == NO_CAGE) {
+					throw std::invalid_argument("There is no cage " + cage_name + " in " + options_.save_file);
+				}
+				replica->canvas.populateInfected(cage_id, number_of_infected, replica->clock.current_time);
+			}
+			replicas[r] = std::move(replica);
+		});
+
+		std::vector<EnsembleRow> rows;
+		for (uint64_t step = 1; step <= options_.steps; step++) {
+			if (cancel && *cancel) break;
+			pool.parallelFor(replicas.size(), [this, &replicas](size_t r, size_t) {
+				Replica& replica = *replicas[r];
+				advanceSimulation(replica.cage_mediator, replica.canvas, replica.clock, options_.step_duration);
+			});
+			if (step % options_.record_every != 0) continue;
+
+			rows.push_back(summarize_(replicas));
+			if (on_row) {
+				on_row(rows.back());
+			}
+		}
+		return rows;
+	}
+
+private:
+	static EnsembleRow summarize_(const std::vector<std::unique_ptr<Replica>>& replicas) {
+		EnsembleRow row;
+		row.step = replicas[0]->clock.step;
+		row.time = replicas[0]->clock.current_time;
+		std::vector<float> values(replicas.size());
+		for (size_t channel = 0; channel < 4; channel++) {
+			for (size_t r = 0; r < replicas.size(); r++) {
+				const DiseaseTotals& totals = replicas[r]->canvas.getTotals();
+				const int numbers[] = { totals.susceptible, totals.infected, totals.recovered, totals.dead };
+				values[r] = static_cast<float>(numbers[channel]);
+			}
+			row.low[channel] = quantile_(values, LOW_QUANTILE);
+			row.median[channel] = quantile_(values, 0.5);
+			row.high[channel] = quantile_(values, HIGH_QUANTILE);
+		}
+		return row;
+	}
+
+	/**
+	 * Quantile p of the values, linear between the two closest of them (values are reordered).
+	 **/
+	static float quantile_(std::vector<float>& values, double p) {
+		const double position = p * (values.size() - 1);
+		const size_t below = static_cast<size_t>(position);
+		std::nth_element(values.begin(), values.begin() + below, values.end());
+		if (below + 1 >= values.size()) return values[below];
+		// after nth_element the next value is the smallest of the ones behind
+		const float above = *std::min_element(values.begin() + below + 1, values.end());
+		return static_cast<float>(values[below] + (position - below) * (above - values[below]));
+	}
+};
+
+/**
+ *	Percentile bands of an ensemble as arrays that can be plotted.
+ **/
+struct EnsembleBands {
+	std::vector<float> time;
+	std::array<std::vector<float>, 4> low;
+	std::array<std::vector<float>, 4> median;
+	std::array<std::vector<float>, 4> high;
+
+	void add(const EnsembleRow& row) {
+		time.push_back(row.time);
+		for (size_t channel = 0; channel < 4; channel++) {
+			low[channel].push_back(row.low[channel]);
+			median[channel].push_back(row.median[channel]);
+			high[channel].push_back(row.high[channel]);
+		}
+	}
+};
+
+/**
+ *	EnsembleRunner on a background thread, for the window. Bands grow while the ensemble runs.
+ **/
+class EnsembleTask {
+	std::mutex mutex_;
+	EnsembleBands bands_;
+	std::string error_;
+	std::atomic<bool> running_{};
+	std::atomic<bool> cancel_{};
+	std::thread thread_;
+
+public:
+	~EnsembleTask() {
+		cancel();
+	}
+
+	/**
+	 * Start a new ensemble, cancelling the one that is running.
+	 **/
+	void start(ThreadPool& pool, EnsembleOptions options) {
+		cancel();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			bands_ = EnsembleBands();
+			error_.clear();
+		}
+		cancel_ = false;
+		running_ = true;
+		thread_ = std::thread([this, &pool, options = std::move(options)]() {
+			try {
+				EnsembleRunner(options).run(pool, [this](const EnsembleRow& row) {
+					std::lock_guard<std::mutex> lock(mutex_);
+					bands_.add(row);
+				}, &cancel_);
+			} catch (const std::exception& e) {
+				std::lock_guard<std::mutex> lock(mutex_);
+				error_ = e.what();
+			}
+			running_ = false;
+		});
+	}
+
+	void cancel() {
+		cancel_ = true;
+		if (thread_.joinable()) {
+			thread_.join();
+		}
+	}
+
+	bool running() const {
+		return running_;
+	}
+
+	/**
+	 * Copy the bands computed so far and the error message, if the run failed.
+	 **/
+	void snapshot(EnsembleBands& bands, std::string& error) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		bands = bands_;
+		error = error_;
+	}
+};
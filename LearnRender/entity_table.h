@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "circle.h"
+
+/**
+ *	Where a circle is stored: the cage and its index in the CircleStorage of the cage.
+ **/
+struct EntityLocation {
+	CageId cage = NO_CAGE;
+	uint32_t index{};
+};
+
+/**
+ *	Table of all circles of the Canvas, addressed by generational handles.
+ *	Data of a circle lives in the CircleStorage of its cage, the table only knows where.
+ *	Slots of removed circles are reused with a new generation, so an old handle is detected instead of
+ *	pointing to another circle.
+ **/
+class EntityTable {
+	struct Slot {
+		uint32_t generation{};
+		bool alive{};
+		EntityLocation location;
+	};
+
+	std::vector<Slot> slots_;
+	std::vector<uint32_t> free_slots_;
+	size_t size_{};
+
+public:
+	EntityHandle create(EntityLocation location) {
+		uint32_t index;
+		if (free_slots_.empty()) {
+			index = static_cast<uint32_t>(slots_.size());
+			slots_.emplace_back();
+		} else {
+			index = free_slots_.back();
+			free_slots_.pop_back();
+		}
+		Slot& slot = slots_[index];
+		slot.alive = true;
+		slot.location = location;
+		size_++;
+		return EntityHandle{ index, slot.generation };
+	}
+
+	/**
+	 * Create count handles for the circles at the indices 0, 1, ... of the cage, into handles.
+	 * Free slots are reused first, the rest of the table grows at once.
+	 **/
+	void createRange(CageId cage, size_t count, EntityHandle* handles) {
+		size_t i = 0;
+		for (; i < count && !free_slots_.empty(); i++) {
+			handles[i] = create(EntityLocation{ cage, static_cast<uint32_t>(i) });
+		}
+		size_t index = slots_.size();
+		slots_.resize(index + count - i);
+		size_ += count - i;
+		for (; i < count; i++, index++) {
+			Slot& slot = slots_[index];
+			slot.alive = true;
+			slot.location = EntityLocation{ cage, static_cast<uint32_t>(i) };
+			handles[i] = EntityHandle{ static_cast<uint32_t>(index), slot.generation };
+		}
+	}
+
+	void destroy(EntityHandle handle) {
+		check_(handle);
+		Slot& slot = slots_[handle.index];
+		slot.alive = false;
+		slot.generation++;
+		free_slots_.push_back(handle.index);
+		size_--;
+	}
+
+	bool isValid(EntityHandle handle) const {
+		return handle.index < slots_.size() && slots_[handle.index].alive && slots_[handle.index].generation == handle.generation;
+	}
+
+	const EntityLocation& locate(EntityHandle handle) const {
+		check_(handle);
+		return slots_[handle.index].location;
+	}
+
+	void relocate(EntityHandle handle, EntityLocation location) {
+		check_(handle);
+		slots_[handle.index].location = location;
+	}
+
+	size_t size() const {
+		return size_;
+	}
+
+	void clear() {
+		slots_.clear();
+		free_slots_.clear();
+		size_ = 0;
+	}
+
+private:
+	void check_(EntityHandle handle) const {
+		if (!isValid(handle)) {
+			throw std::out_of_range("Handle of a removed circle");
+		}
+	}
+};
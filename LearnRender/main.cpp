@@ -6,8 +6,12 @@
 
 #include "settings.h"
 #include "util.h"
+#include "render_util.h"
 #include "canvas.h"
+#include "canvas_renderer.h"
 #include "cage_mediator.h"
+#include "profiler.h"
+#include "simulation_thread.h"
 #include "ui_controls.h"
 
 
@@ -17,19 +21,26 @@ int main(void) {
 	
 	IMGUIBeginRendering(window);
 
+	ThreadPool thread_pool;
+
 	Canvas canvas(glm::vec2(0, 0), VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
+	canvas.setThreadPool(&thread_pool);
+
+	CanvasRenderer canvas_renderer;
 
 	CageMediator cage_mediator(&canvas);
 	
-	UIControls ui_controls(canvas, cage_mediator);
+	SimulationClock clock;
 
-	TimeController time_controller;
-	
+	// files are created only when the export is turned on in the UI
+	MetricsExporter metrics_exporter(DIRECTORY_FOR_SAVES + "/metrics-" + getTimesStamp());
+
+	// from here on the simulation steps on its own thread, the UI reads and changes it only inside access()
+	SimulationThread simulation(canvas, cage_mediator, clock);
+
+	UIControls ui_controls(simulation, canvas, cage_mediator, clock, metrics_exporter);
 
 	while (!glfwWindowShouldClose(window)) {
-		time_controller.update(SIMULATION_SPEED);
-		cage_mediator.update(time_controller.scaled_current_time);
-		
 		glClearColor(.5f, .5f, .5f, .5f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
@@ -37,7 +48,15 @@ int main(void) {
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
 
-		ui_controls.update(time_controller.scaled_current_time);
+		const CanvasSnapshot& snapshot = simulation.snapshot();
+		{
+			PROFILE_SCOPE("UIControls::update");
+			ui_controls.update(snapshot);
+		}
+		if (ImGui::Begin("Configuration")) {
+			ImGui::Text("%.0f steps/s, %.0f frames/s", snapshot.steps_per_second, ImGui::GetIO().Framerate);
+		}
+		ImGui::End();
 
 		if (ImGui::Begin(
 			"Viewport", nullptr,
@@ -47,25 +66,32 @@ int main(void) {
 			ImGuiWindowFlags_NoFocusOnAppearing |
 			ImGuiWindowFlags_NoBackground
 		)) {
-
-			canvas.update(time_controller.scaled_current_time);
-
 			ImDrawList* drawList = ImGui::GetWindowDrawList();
 
-			canvas.drawCircles(drawList);
+			canvas_renderer.drawHeatmaps(drawList, snapshot);
+
+			canvas_renderer.drawCircles(drawList, snapshot);
 
-			canvas.drawCages(drawList);
+			canvas_renderer.drawCages(drawList, snapshot);
 		}
 		ImGui::End();
 
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		{
+			PROFILE_SCOPE("ImGui::Render");
+			ImGui::Render();
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		}
 
-		/* Swap front and back buffers */
-		glfwSwapBuffers(window);
+		{
+			PROFILE_SCOPE("glfwSwapBuffers");
+			/* Swap front and back buffers */
+			glfwSwapBuffers(window);
+		}
 
 		/* Poll for and process events */
 		glfwPollEvents();
+
+		PROFILE_FRAME();
 	}
 
 	ImGui_ImplOpenGL3_Shutdown();
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ *	Read-only view of a whole file mapped into memory.
+ *	Pages are read by the system when they are touched, so opening even a very big file is instant.
+ **/
+class MappedFile {
+	const unsigned char* data_ = nullptr;
+	size_t size_{};
+#ifdef _WIN32
+	HANDLE file_ = INVALID_HANDLE_VALUE;
+	HANDLE mapping_ = nullptr;
+#else
+	int file_ = -1;
+#endif
+
+public:
+	explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+		file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file_ == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("Could not open " + path);
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file_, &size)) {
+			close_();
+			throw std::runtime_error("Could not get the size of " + path);
+		}
+		size_ = static_cast<size_t>(size.QuadPart);
+		if (size_ == 0) return;
+		mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping_) {
+			data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+		}
+#else
+		file_ = open(path.c_str(), O_RDONLY);
+		if (file_ < 0) {
+			throw std::runtime_error("Could not open " + path);
+		}
+		struct stat status;
+		if (fstat(file_, &status) != 0) {
+			close_();
+			throw std::runtime_error("Could not get the size of " + path);
+		}
+		size_ = static_cast<size_t>(status.st_size);
+		if (size_ == 0) return;
+		void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0);
+		if (data != MAP_FAILED) {
+			data_ = static_cast<const unsigned char*>(data);
+			// the file is read from the beginning to the end once
+			madvise(data, size_, MADV_SEQUENTIAL);
+		}
+#endif
+		if (!data_) {
+			close_();
+			throw std::runtime_error("Could not map " + path + " into memory");
+		}
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+		close_();
+	}
+
+	const unsigned char* data() const {
+		return data_;
+	}
+
+	size_t size() const {
+		return size_;
+	}
+
+private:
+	void close_() {
+#ifdef _WIN32
+		if (data_) UnmapViewOfFile(data_);
+		if (mapping_) CloseHandle(mapping_);
+		if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+		file_ = INVALID_HANDLE_VALUE;
+		mapping_ = nullptr;
+#else
+		if (data_) munmap(const_cast<unsigned char*>(data_), size_);
+		if (file_ >= 0) ::close(file_);
+		file_ = -1;
+#endif
+		data_ = nullptr;
+	}
+};
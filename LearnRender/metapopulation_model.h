@@ -0,0 +1,315 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "canvas.h"
+#include "movement_kernel.h"
+#include "settings.h"
+#include "simulation_params.h"
+
+/**
+ *	Totals of the compartments at regular times.
+ **/
+struct OdeSeries {
+	std::vector<float> time;
+	std::vector<float> susceptible;
+	std::vector<float> infected;
+	std::vector<float> recovered;
+	std::vector<float> dead;
+
+	void clear() {
+		time.clear();
+		susceptible.clear();
+		infected.clear();
+		recovered.clear();
+		dead.clear();
+	}
+};
+
+/**
+ *	Deterministic SIRD model of the canvas, a preview of what the circles will do that takes milliseconds.
+ *
+ *	Circles are grouped by home cage and destination cage, that is by the flows they were given. A group without
+ *	a destination stays at home. A group with one rests at home and at the destination for the mean time to rest
+ *	in a cage and travels between them in straight lines, passing through the cages on the way; it is present in
+ *	every cage for the share of this cycle that it spends there. Circles move MAX_AXIS_SPEED units of length a unit of
+ *	time along the longer axis, as the movement kernel moves them.
+ *	Calibration from the parameters of the canvas:
+ *	- a susceptible circle meets the infected ones of a cage within the interaction distance d = 2 * CIRCLE_RADIUS,
+ *	  so in a cage of area A it becomes infected at the rate -ln(1 - infection_probability) * pi * d^2 / A per infected
+ *	  circle present, the hazard rate of a contact that the circles integrate over their steps;
+ *	- infected circles stop being infected at the rate 1 / mean recovery time and die with death_probability.
+ *	The initial state is the current state of the circles, so a preview can be made at any moment of a run.
+ **/
+class MetapopulationModel {
+	// susceptible, infected, recovered, dead
+	using Totals = std::array<double, 4>;
+
+	size_t groups_{};
+	size_t cages_{};
+	// cages where group g is present are presence_cage_[presence_begin_[g] .. presence_begin_[g + 1]),
+	// with the share of time it spends in each
+	std::vector<size_t> presence_begin_;
+	std::vector<uint32_t> presence_cage_;
+	std::vector<double> presence_share_;
+	std::vector<double> contact_rate_;
+	double recovery_rate_{};
+	double death_probability_{};
+	// S of all groups, then I, R and D
+	std::vector<double> initial_state_;
+
+public:
+	explicit MetapopulationModel(const Canvas& canvas) {
+		const SimulationParams& params = canvas.getParams();
+		const auto& cages = canvas.getCages();
+		cages_ = cages.size();
+		const double interaction_distance = 2 * CIRCLE_RADIUS;
+		const double pi = 3.14159265358979323846;
+		contact_rate_.resize(cages_);
+		for (size_t c = 0; c < cages_; c++) {
+			const Coordinates coordinates = cages[c].getCoordinates();
+			const double area = std::max(1.0, static_cast<double>(coordinates.width) * coordinates.height);
+			contact_rate_[c] = params.infectionRate() * pi * interaction_distance * interaction_distance / area;
+		}
+		const double mean_recovery_time = (params.recovery_time_min + params.recovery_time_max) / 2.0;
+		// recovery times below a unit of time would make the system stiff, the circles take a step to recover anyway
+		recovery_rate_ = 1.0 / std::max(mean_recovery_time, 1.0);
+		death_probability_ = params.death_probability;
+
+		const double mean_rest_time = (params.time_to_rest_in_cage_min + params.time_to_rest_in_cage_max) / 2.0;
+		std::unordered_map<uint64_t, size_t> group_ids;
+		std::vector<std::array<double, 4>> counts;
+		presence_begin_.push_back(0);
+		for (const auto& cage : cages) {
+			const CircleStorage& circles = cage.getCircles();
+			for (size_t i = 0; i < circles.size(); i++) {
+				const CageId home = circles.home_cage[i] == NO_CAGE ? cage.id : circles.home_cage[i];
+				const CageId destination = circles.destination_cage[i];
+				const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(home)) << 32) | static_cast<uint32_t>(destination);
+				auto [it, inserted] = group_ids.try_emplace(key, counts.size());
+				if (inserted) {
+					counts.push_back({});
+					addPresence_(canvas, home, destination, mean_rest_time);
+				}
+				counts[it->second][static_cast<size_t>(circles.stage[i])]++;
+			}
+		}
+		groups_ = counts.size();
+		initial_state_.resize(4 * groups_);
+		for (size_t g = 0; g < groups_; g++) {
+			for (size_t compartment = 0; compartment < 4; compartment++) {
+				initial_state_[compartment * groups_ + g] = counts[g][compartment];
+			}
+		}
+	}
+
+	/**
+	 * Integrate from start_time for duration with adaptive RK4 and return the totals every output_interval.
+	 * tolerance is the allowed local error relative to the size of a compartment (and absolute, in circles, for small ones).
+	 * Steps are not cut at the output times, the totals between the ends of a step are interpolated.
+	 **/
+	OdeSeries integrate(float start_time, float duration, float output_interval, double tolerance = 1e-6) const {
+		if (output_interval <= 0 || duration < 0) {
+			throw std::invalid_argument("Output interval must be positive and duration must not be negative");
+		}
+		const size_t n = initial_state_.size();
+		std::vector<double> state = initial_state_;
+		std::vector<double> full(n), half(n), slope(n), scratch(5 * n + cages_);
+		double* pressure = scratch.data() + 5 * n;
+
+		OdeSeries series;
+		Totals totals = totals_(state.data());
+		derivative_(state.data(), slope.data(), pressure);
+		Totals totals_slope = totals_(slope.data());
+		record_(series, start_time, totals);
+
+		const size_t outputs = static_cast<size_t>(std::floor(duration / output_interval + 1e-9));
+		const double end_time = outputs * static_cast<double>(output_interval);
+		size_t next_output = 1;
+		double time = 0;
+		double step = output_interval;
+		while (next_output <= outputs) {
+			const double h = std::min(step, end_time - time);
+			// one step of h against two steps of h / 2; their difference estimates the error
+			rk4Step_(state, h, full, scratch);
+			rk4Step_(state, h / 2, half, scratch);
+			rk4Step_(half, h / 2, half, scratch);
+			double error = 0;
+			for (size_t i = 0; i < n; i++) {
+				const double scale = tolerance * std::max(1.0, std::abs(half[i]));
+				error = std::max(error, std::abs(half[i] - full[i]) / (15 * scale));
+			}
+			const double factor = error > 0 ? 0.9 * std::pow(error, -0.2) : 4.0;
+			if (error > 1) {
+				step = h * std::max(0.1, factor);
+				continue;
+			}
+
+			for (size_t i = 0; i < n; i++) {
+				state[i] = std::max(0.0, half[i] + (half[i] - full[i]) / 15);
+			}
+			const Totals next_totals = totals_(state.data());
+			derivative_(state.data(), slope.data(), pressure);
+			const Totals next_totals_slope = totals_(slope.data());
+			// cubic Hermite interpolation between the ends of the step
+			while (next_output <= outputs && next_output * static_cast<double>(output_interval) <= time + h * (1 + 1e-12)) {
+				const double t = std::min(1.0, (next_output * static_cast<double>(output_interval) - time) / h);
+				const double h00 = (1 + 2 * t) * (1 - t) * (1 - t);
+				const double h10 = t * (1 - t) * (1 - t);
+				const double h01 = t * t * (3 - 2 * t);
+				const double h11 = t * t * (t - 1);
+				Totals interpolated;
+				for (size_t compartment = 0; compartment < 4; compartment++) {
+					interpolated[compartment] = h00 * totals[compartment] + h10 * h * totals_slope[compartment]
+						+ h01 * next_totals[compartment] + h11 * h * next_totals_slope[compartment];
+				}
+				record_(series, static_cast<float>(start_time + next_output * static_cast<double>(output_interval)), interpolated);
+				next_output++;
+			}
+			time += h;
+			totals = next_totals;
+			totals_slope = next_totals_slope;
+			// a step cut short by the end says nothing about the size of the next one
+			if (h == step) {
+				step = h * std::min(4.0, factor);
+			}
+		}
+		return series;
+	}
+
+	size_t groupCount() const {
+		return groups_;
+	}
+
+private:
+	/**
+	 * Shares of time of a new group in the cages.
+	 **/
+	void addPresence_(const Canvas& canvas, CageId home, CageId destination, double mean_rest_time) {
+		if (destination == NO_CAGE || destination == home) {
+			presence_cage_.push_back(static_cast<uint32_t>(home));
+			presence_share_.push_back(1);
+			presence_begin_.push_back(presence_cage_.size());
+			return;
+		}
+		std::vector<double> time_in_cage(cages_, 0.0);
+		time_in_cage[home] += mean_rest_time;
+		time_in_cage[destination] += mean_rest_time;
+		const double travel_time = addTravel_(canvas, home, destination, time_in_cage) + addTravel_(canvas, destination, home, time_in_cage);
+		const double cycle = 2 * mean_rest_time + travel_time;
+		for (size_t c = 0; c < cages_; c++) {
+			if (time_in_cage[c] > 0) {
+				presence_cage_.push_back(static_cast<uint32_t>(c));
+				presence_share_.push_back(cycle > 0 ? time_in_cage[c] / cycle : 0.5);
+			}
+		}
+		presence_begin_.push_back(presence_cage_.size());
+	}
+
+	/**
+	 * Walk from the center of one cage towards the center of the other until the other is entered,
+	 * add the time spent in every cage on the way and return the time of the walk.
+	 **/
+	static double addTravel_(const Canvas& canvas, CageId from, CageId to, std::vector<double>& time_in_cage) {
+		const glm::vec2 start = center_(canvas.getCages()[from]);
+		const glm::vec2 path = center_(canvas.getCages()[to]) - start;
+		const double duration = std::max(std::abs(path.x), std::abs(path.y)) / MAX_AXIS_SPEED;
+		const size_t samples = std::max<size_t>(1, static_cast<size_t>(std::ceil(duration / CIRCLE_RADIUS)));
+		const double sample_duration = duration / samples;
+		double travelled = 0;
+		for (size_t k = 0; k < samples; k++) {
+			const glm::vec2 point = start + path * ((k + 0.5f) / samples);
+			const CageId cage = canvas.findCageAt(point);
+			if (cage == to) break;
+			if (cage != NO_CAGE) {
+				time_in_cage[cage] += sample_duration;
+			}
+			travelled += sample_duration;
+		}
+		return travelled;
+	}
+
+	static glm::vec2 center_(const Cage& cage) {
+		const Coordinates coordinates = cage.getCoordinates();
+		return coordinates.top_left_corner + glm::vec2(coordinates.width / 2.f, coordinates.height / 2.f);
+	}
+
+	/**
+	 * derivative = f(state). Both are laid out as S, I, R, D of all groups; pressure has room for every cage.
+	 **/
+	void derivative_(const double* state, double* derivative, double* pressure) const {
+		const double* susceptible = state;
+		const double* infected = state + groups_;
+		std::fill(pressure, pressure + cages_, 0.0);
+		for (size_t g = 0; g < groups_; g++) {
+			for (size_t k = presence_begin_[g]; k < presence_begin_[g + 1]; k++) {
+				pressure[presence_cage_[k]] += presence_share_[k] * infected[g];
+			}
+		}
+		for (size_t c = 0; c < cages_; c++) {
+			pressure[c] *= contact_rate_[c];
+		}
+		double* d_susceptible = derivative;
+		double* d_infected = derivative + groups_;
+		double* d_recovered = derivative + 2 * groups_;
+		double* d_dead = derivative + 3 * groups_;
+		for (size_t g = 0; g < groups_; g++) {
+			double exposure = 0;
+			for (size_t k = presence_begin_[g]; k < presence_begin_[g + 1]; k++) {
+				exposure += presence_share_[k] * pressure[presence_cage_[k]];
+			}
+			const double infections = exposure * susceptible[g];
+			const double removals = recovery_rate_ * infected[g];
+			d_susceptible[g] = -infections;
+			d_infected[g] = infections - removals;
+			d_recovered[g] = (1 - death_probability_) * removals;
+			d_dead[g] = death_probability_ * removals;
+		}
+	}
+
+	/**
+	 * result = state advanced by h. result may be the same vector as state.
+	 **/
+	void rk4Step_(const std::vector<double>& state, double h, std::vector<double>& result, std::vector<double>& scratch) const {
+		const size_t n = state.size();
+		double* k1 = scratch.data();
+		double* k2 = k1 + n;
+		double* k3 = k2 + n;
+		double* k4 = k3 + n;
+		double* point = k4 + n;
+		double* pressure = point + n;
+		derivative_(state.data(), k1, pressure);
+		for (size_t i = 0; i < n; i++) point[i] = state[i] + h / 2 * k1[i];
+		derivative_(point, k2, pressure);
+		for (size_t i = 0; i < n; i++) point[i] = state[i] + h / 2 * k2[i];
+		derivative_(point, k3, pressure);
+		for (size_t i = 0; i < n; i++) point[i] = state[i] + h * k3[i];
+		derivative_(point, k4, pressure);
+		for (size_t i = 0; i < n; i++) {
+			result[i] = state[i] + h / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+		}
+	}
+
+	Totals totals_(const double* state) const {
+		Totals totals{};
+		for (size_t compartment = 0; compartment < 4; compartment++) {
+			for (size_t g = 0; g < groups_; g++) {
+				totals[compartment] += state[compartment * groups_ + g];
+			}
+		}
+		return totals;
+	}
+
+	static void record_(OdeSeries& series, float time, const Totals& totals) {
+		series.time.push_back(time);
+		series.susceptible.push_back(static_cast<float>(std::max(0.0, totals[0])));
+		series.infected.push_back(static_cast<float>(std::max(0.0, totals[1])));
+		series.recovered.push_back(static_cast<float>(std::max(0.0, totals[2])));
+		series.dead.push_back(static_cast<float>(std::max(0.0, totals[3])));
+	}
+};
@@ -0,0 +1,221 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "circle.h"
+#include "spsc_ring_buffer.h"
+
+/**
+ *	One row of the metrics: disease stages of a cage after a step, or of the whole canvas when cage is NO_CAGE.
+ *	cage_names is the table of names the cage id refers to, as returned by MetricsExporter::addCageNames.
+ *	update_milliseconds is the time the step took and is set only in the rows of the whole canvas.
+ **/
+struct MetricsRecord {
+	uint64_t step{};
+	float time{};
+	CageId cage = NO_CAGE;
+	uint32_t cage_names{};
+	int susceptible{};
+	int infected{};
+	int recovered{};
+	int dead{};
+	float update_milliseconds{};
+};
+
+/**
+ *	Writes MetricsRecords to CSV files on its own thread.
+ *	The simulation only puts records into a lock-free ring buffer and never waits for the disk;
+ *	if the writer falls behind and the buffer is full, records are dropped and counted.
+ *	Files are named <base_path>-0000.csv, <base_path>-0001.csv, ... and a new one is started when the current
+ *	one grows past max_file_bytes. Nothing is created until the first record arrives.
+ *	If a file cannot be created or written, the exporter stops: error() tells why and later records are dropped.
+ *	Every row has the id and the name of its cage; the name is left empty in the rows of the whole canvas.
+ **/
+class MetricsExporter {
+	SpscRingBuffer<MetricsRecord> records_;
+	std::string base_path_;
+	size_t max_file_bytes_;
+	std::ofstream file_;
+	size_t file_bytes_{};
+	int file_index_{};
+	std::atomic<uint64_t> dropped_{};
+	// tables of cage names by cage id; a deque, so the writer can keep a pointer to a table while others are added
+	std::deque<std::vector<std::string>> cage_names_;
+	std::mutex cage_names_mutex_;
+	// set once by the writer thread before failed_
+	std::string error_;
+	std::atomic<bool> failed_{};
+	std::atomic<bool> stop_{};
+	std::thread writer_;
+
+public:
+	explicit MetricsExporter(std::string base_path, size_t max_file_bytes = 64 << 20, size_t capacity = 1 << 16) :
+		records_(capacity),
+		base_path_(std::move(base_path)),
+		max_file_bytes_(max_file_bytes) {
+		writer_ = std::thread([this]() { writerLoop_(); });
+	}
+
+	MetricsExporter(const MetricsExporter&) = delete;
+	MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+	/**
+	 * Records that are already in the buffer are written before the exporter is destroyed.
+	 **/
+	~MetricsExporter() {
+		close();
+	}
+
+	/**
+	 * Write the records that are in the buffer and stop the writer. Nothing may be published afterwards.
+	 **/
+	void close() {
+		if (!writer_.joinable()) return;
+		stop_ = true;
+		writer_.join();
+	}
+
+	/**
+	 * Called by the simulation thread only. Returns false if the record was dropped.
+	 **/
+	bool publish(const MetricsRecord& record) {
+		if (failed_.load(std::memory_order_relaxed)) return false;
+		if (records_.tryPush(record)) return true;
+		dropped_++;
+		return false;
+	}
+
+	/**
+	 * Add a table of cage names, for records of cages added or replaced since the last one. Returns its index,
+	 * the cage_names of those records. Called by the simulation thread only.
+	 **/
+	uint32_t addCageNames(std::vector<std::string> names) {
+		std::lock_guard<std::mutex> lock(cage_names_mutex_);
+		cage_names_.push_back(std::move(names));
+		return static_cast<uint32_t>(cage_names_.size() - 1);
+	}
+
+	uint64_t dropped() const {
+		return dropped_;
+	}
+
+	bool failed() const {
+		return failed_.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * Why the export stopped, empty while it works.
+	 **/
+	std::string error() const {
+		return failed() ? error_ : std::string();
+	}
+
+private:
+	void writerLoop_() {
+		std::string buffer;
+		MetricsRecord record;
+		const std::vector<std::string>* names = nullptr;
+		uint32_t names_index = 0;
+		while (true) {
+			// read stop_ before draining, so nothing published before the stop is lost
+			const bool stopping = stop_;
+			buffer.clear();
+			while (buffer.size() < (1 << 16) && records_.tryPop(record)) {
+				if (!names || record.cage_names != names_index) {
+					names = cageNames_(record.cage_names);
+					names_index = record.cage_names;
+				}
+				appendRow_(buffer, record, *names);
+			}
+			if (!buffer.empty()) {
+				if (!failed_.load(std::memory_order_relaxed)) {
+					write_(buffer);
+				}
+				continue;
+			}
+			if (stopping) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+		file_.close();
+	}
+
+	const std::vector<std::string>* cageNames_(uint32_t index) {
+		static const std::vector<std::string> no_names;
+		std::lock_guard<std::mutex> lock(cage_names_mutex_);
+		return index < cage_names_.size() ? &cage_names_[index] : &no_names;
+	}
+
+	static void appendRow_(std::string& buffer, const MetricsRecord& record, const std::vector<std::string>& cage_names) {
+		char row[160];
+		int length = std::snprintf(row, sizeof(row), "%llu,%g,%d,",
+			static_cast<unsigned long long>(record.step), record.time, record.cage);
+		buffer.append(row, length > 0 ? static_cast<size_t>(length) : 0);
+		if (record.cage >= 0 && static_cast<size_t>(record.cage) < cage_names.size()) {
+			appendField_(buffer, cage_names[record.cage]);
+		}
+		length = std::snprintf(row, sizeof(row), ",%d,%d,%d,%d,%g\n",
+			record.susceptible, record.infected, record.recovered, record.dead, record.update_milliseconds);
+		buffer.append(row, length > 0 ? static_cast<size_t>(length) : 0);
+	}
+
+	/**
+	 * A name with a comma, a quote or a line break is quoted, quotes in it are doubled.
+	 **/
+	static void appendField_(std::string& buffer, const std::string& field) {
+		if (field.find_first_of(",\"\r\n") == std::string::npos) {
+			buffer += field;
+			return;
+		}
+		buffer += '"';
+		for (const char c : field) {
+			if (c == '"') buffer += '"';
+			buffer += c;
+		}
+		buffer += '"';
+	}
+
+	void write_(const std::string& rows) {
+		if (!file_.is_open() || file_bytes_ >= max_file_bytes_) {
+			openNextFile_();
+		}
+		if (failed_.load(std::memory_order_relaxed)) return;
+		file_.write(rows.data(), static_cast<std::streamsize>(rows.size()));
+		file_bytes_ += rows.size();
+		if (!file_) {
+			fail_("Could not write the metrics file " + base_path_ + suffix_(file_index_ - 1));
+		}
+	}
+
+	void openNextFile_() {
+		file_.close();
+		const std::string path = base_path_ + suffix_(file_index_++);
+		file_.open(path, std::ios::out | std::ios::trunc);
+		if (!file_.is_open()) {
+			fail_("Could not create the metrics file " + path);
+			return;
+		}
+		const std::string header = "step,time,cage,cage_name,susceptible,infected,recovered,dead,update_ms\n";
+		file_ << header;
+		file_bytes_ = header.size();
+	}
+
+	static std::string suffix_(int file_index) {
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), "-%04d.csv", file_index);
+		return suffix;
+	}
+
+	void fail_(std::string error) {
+		error_ = std::move(error);
+		failed_.store(true, std::memory_order_release);
+		file_.close();
+	}
+};
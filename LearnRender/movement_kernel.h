@@ -0,0 +1,159 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "circle.h"
+
+/**
+ *	Arrays and parameters of one call of moveCirclesKernel.
+ **/
+struct MovementBatch {
+	float* x;
+	float* y;
+	float* dx;
+	float* dy;
+	const DiseaseStages* stage;
+	const CircleMovingState* moving_state;
+	float delta_time;
+	float min_x, min_y, max_x, max_y;
+};
+
+/**
+ * Units of length a circle moves in a unit of time for each unit of its direction.
+ */
+constexpr float CIRCLE_SPEED = 2.f;
+
+/**
+ * Directions are at most 1 along each axis (the CageMediator scales them so), so a circle moves at most
+ * MAX_AXIS_SPEED units of length along an axis in a unit of time.
+ */
+constexpr float MAX_AXIS_SPEED = CIRCLE_SPEED;
+
+/**
+ * Move one circle: step by direction * CIRCLE_SPEED * delta_time; a resting circle that would leave the area has
+ * its direction reflected from the wall (from both walls in a corner) and makes the step from where it was with the
+ * new direction. Dead circles do not move. This is the reference for the vectorised versions below.
+ */
+inline void moveCircle(const MovementBatch& batch, size_t i) {
+	if (batch.stage[i] == DiseaseStages::DEAD) return;
+	const float step = CIRCLE_SPEED * batch.delta_time;
+	const float x = batch.x[i] + batch.dx[i] * step;
+	const float y = batch.y[i] + batch.dy[i] * step;
+	const bool resting = batch.moving_state[i] == CircleMovingState::RESTING;
+	const bool reflect_x = resting && (x < batch.min_x || x > batch.max_x);
+	const bool reflect_y = resting && (y < batch.min_y || y > batch.max_y);
+	if (reflect_x) batch.dx[i] = -batch.dx[i];
+	if (reflect_y) batch.dy[i] = -batch.dy[i];
+	const bool reflected = reflect_x || reflect_y;
+	batch.x[i] = reflected ? batch.x[i] + batch.dx[i] * step : x;
+	batch.y[i] = reflected ? batch.y[i] + batch.dy[i] * step : y;
+}
+
+#if defined(__AVX2__)
+
+inline __m256 movementLaneMask_(const uint8_t* bytes, uint8_t value) {
+	__m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(bytes));
+	__m256i lanes = _mm256_cvtepu8_epi32(packed);
+	return _mm256_castsi256_ps(_mm256_cmpeq_epi32(lanes, _mm256_set1_epi32(value)));
+}
+
+/**
+ * Move circles [begin, end) eight at a time. Branches of moveCircle are replaced by lane masks.
+ */
+inline void moveCirclesKernel(const MovementBatch& batch, size_t begin, size_t end) {
+	const __m256 step = _mm256_set1_ps(CIRCLE_SPEED * batch.delta_time);
+	const __m256 min_x = _mm256_set1_ps(batch.min_x), max_x = _mm256_set1_ps(batch.max_x);
+	const __m256 min_y = _mm256_set1_ps(batch.min_y), max_y = _mm256_set1_ps(batch.max_y);
+	const __m256 sign = _mm256_set1_ps(-0.f);
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8) {
+		const __m256 dead = movementLaneMask_(reinterpret_cast<const uint8_t*>(batch.stage + i), static_cast<uint8_t>(DiseaseStages::DEAD));
+		const __m256 resting = movementLaneMask_(reinterpret_cast<const uint8_t*>(batch.moving_state + i), static_cast<uint8_t>(CircleMovingState::RESTING));
+		const __m256 x = _mm256_loadu_ps(batch.x + i), y = _mm256_loadu_ps(batch.y + i);
+		const __m256 dx = _mm256_loadu_ps(batch.dx + i), dy = _mm256_loadu_ps(batch.dy + i);
+
+		const __m256 next_x = _mm256_add_ps(x, _mm256_mul_ps(dx, step));
+		const __m256 next_y = _mm256_add_ps(y, _mm256_mul_ps(dy, step));
+		const __m256 reflect_x = _mm256_and_ps(resting, _mm256_or_ps(_mm256_cmp_ps(next_x, min_x, _CMP_LT_OQ), _mm256_cmp_ps(next_x, max_x, _CMP_GT_OQ)));
+		const __m256 reflect_y = _mm256_and_ps(resting, _mm256_or_ps(_mm256_cmp_ps(next_y, min_y, _CMP_LT_OQ), _mm256_cmp_ps(next_y, max_y, _CMP_GT_OQ)));
+		const __m256 reflected = _mm256_or_ps(reflect_x, reflect_y);
+		const __m256 new_dx = _mm256_xor_ps(dx, _mm256_and_ps(reflect_x, sign));
+		const __m256 new_dy = _mm256_xor_ps(dy, _mm256_and_ps(reflect_y, sign));
+		const __m256 new_x = _mm256_blendv_ps(next_x, _mm256_add_ps(x, _mm256_mul_ps(new_dx, step)), reflected);
+		const __m256 new_y = _mm256_blendv_ps(next_y, _mm256_add_ps(y, _mm256_mul_ps(new_dy, step)), reflected);
+
+		_mm256_storeu_ps(batch.x + i, _mm256_blendv_ps(new_x, x, dead));
+		_mm256_storeu_ps(batch.y + i, _mm256_blendv_ps(new_y, y, dead));
+		_mm256_storeu_ps(batch.dx + i, _mm256_blendv_ps(new_dx, dx, dead));
+		_mm256_storeu_ps(batch.dy + i, _mm256_blendv_ps(new_dy, dy, dead));
+	}
+	for (; i < end; i++) {
+		moveCircle(batch, i);
+	}
+}
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+inline __m128 movementLaneMask_(const uint8_t* bytes, uint8_t value) {
+	int32_t packed;
+	std::memcpy(&packed, bytes, sizeof(packed));
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lanes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(lanes, _mm_set1_epi32(value)));
+}
+
+inline __m128 movementSelect_(__m128 mask, __m128 if_true, __m128 if_false) {
+	return _mm_or_ps(_mm_and_ps(mask, if_true), _mm_andnot_ps(mask, if_false));
+}
+
+/**
+ * Move circles [begin, end) four at a time. Branches of moveCircle are replaced by lane masks.
+ */
+inline void moveCirclesKernel(const MovementBatch& batch, size_t begin, size_t end) {
+	const __m128 step = _mm_set1_ps(CIRCLE_SPEED * batch.delta_time);
+	const __m128 min_x = _mm_set1_ps(batch.min_x), max_x = _mm_set1_ps(batch.max_x);
+	const __m128 min_y = _mm_set1_ps(batch.min_y), max_y = _mm_set1_ps(batch.max_y);
+	const __m128 sign = _mm_set1_ps(-0.f);
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4) {
+		const __m128 dead = movementLaneMask_(reinterpret_cast<const uint8_t*>(batch.stage + i), static_cast<uint8_t>(DiseaseStages::DEAD));
+		const __m128 resting = movementLaneMask_(reinterpret_cast<const uint8_t*>(batch.moving_state + i), static_cast<uint8_t>(CircleMovingState::RESTING));
+		const __m128 x = _mm_loadu_ps(batch.x + i), y = _mm_loadu_ps(batch.y + i);
+		const __m128 dx = _mm_loadu_ps(batch.dx + i), dy = _mm_loadu_ps(batch.dy + i);
+
+		const __m128 next_x = _mm_add_ps(x, _mm_mul_ps(dx, step));
+		const __m128 next_y = _mm_add_ps(y, _mm_mul_ps(dy, step));
+		const __m128 reflect_x = _mm_and_ps(resting, _mm_or_ps(_mm_cmplt_ps(next_x, min_x), _mm_cmpgt_ps(next_x, max_x)));
+		const __m128 reflect_y = _mm_and_ps(resting, _mm_or_ps(_mm_cmplt_ps(next_y, min_y), _mm_cmpgt_ps(next_y, max_y)));
+		const __m128 reflected = _mm_or_ps(reflect_x, reflect_y);
+		const __m128 new_dx = _mm_xor_ps(dx, _mm_and_ps(reflect_x, sign));
+		const __m128 new_dy = _mm_xor_ps(dy, _mm_and_ps(reflect_y, sign));
+		const __m128 new_x = movementSelect_(reflected, _mm_add_ps(x, _mm_mul_ps(new_dx, step)), next_x);
+		const __m128 new_y = movementSelect_(reflected, _mm_add_ps(y, _mm_mul_ps(new_dy, step)), next_y);
+
+		_mm_storeu_ps(batch.x + i, movementSelect_(dead, x, new_x));
+		_mm_storeu_ps(batch.y + i, movementSelect_(dead, y, new_y));
+		_mm_storeu_ps(batch.dx + i, movementSelect_(dead, dx, new_dx));
+		_mm_storeu_ps(batch.dy + i, movementSelect_(dead, dy, new_dy));
+	}
+	for (; i < end; i++) {
+		moveCircle(batch, i);
+	}
+}
+
+#else
+
+inline void moveCirclesKernel(const MovementBatch& batch, size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++) {
+		moveCircle(batch, i);
+	}
+}
+
+#endif
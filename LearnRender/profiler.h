@@ -0,0 +1,254 @@
+#pragma once
+
+/**
+ *	PROFILE_SCOPE("name") measures the rest of the enclosing block, PROFILE_FRAME() ends a frame of the window.
+ *	Both are empty unless SIMULATION_PROFILER is 1, which it is by default in builds without NDEBUG,
+ *	so release builds contain no timers at all.
+ **/
+#ifndef SIMULATION_PROFILER
+#ifdef NDEBUG
+#define SIMULATION_PROFILER 0
+#else
+#define SIMULATION_PROFILER 1
+#endif
+#endif
+
+#if SIMULATION_PROFILER
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "spsc_ring_buffer.h"
+
+struct ProfileEvent {
+	const char* name{};
+	int64_t start_nanoseconds{};
+	int64_t end_nanoseconds{};
+	uint32_t thread{};
+};
+
+/**
+ *	Collects the events of the scopes of all threads.
+ *	A thread puts its events into a ring buffer of its own and never waits; when the buffer is full the event is dropped.
+ *	endFrame() is called by one thread, the one that draws, and turns the events of the frame into the time
+ *	every scope took in the frame, summed over the threads, for the last HISTORY frames.
+ *	While recording, the events are also kept for a Chrome trace (chrome://tracing, Perfetto).
+ **/
+class Profiler {
+public:
+	static constexpr size_t HISTORY = 300;
+	static constexpr size_t MAX_TRACE_EVENTS = 1 << 21;
+
+	/**
+	 * Milliseconds of a scope in each of the last HISTORY frames, oldest at offset.
+	 **/
+	struct ScopeHistory {
+		std::vector<float> milliseconds = std::vector<float>(HISTORY);
+		int offset{};
+		int calls{};
+	};
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr size_t EVENTS_PER_THREAD = 1 << 16;
+
+	struct ThreadEvents {
+		SpscRingBuffer<ProfileEvent> events{ EVENTS_PER_THREAD };
+		uint32_t thread{};
+	};
+
+	/**
+	 * Owned by a thread that records events: registers its buffer on the first event and frees it when the thread exits.
+	 **/
+	class ThreadRegistration {
+		ThreadEvents* events_;
+	public:
+		ThreadRegistration() : events_(Profiler::instance().registerThread_()) {}
+
+		ThreadRegistration(const ThreadRegistration&) = delete;
+		ThreadRegistration& operator=(const ThreadRegistration&) = delete;
+
+		~ThreadRegistration() {
+			Profiler::instance().unregisterThread_(events_);
+		}
+
+		ThreadEvents* events() const {
+			return events_;
+		}
+	};
+
+	const Clock::time_point epoch_ = Clock::now();
+	std::mutex threads_mutex_;
+	std::vector<std::unique_ptr<ThreadEvents>> threads_;
+	uint32_t next_thread_{};
+	// events of threads that exited before the frame ended, at most EVENTS_PER_THREAD
+	std::vector<ProfileEvent> exited_events_;
+	std::atomic<size_t> dropped_{};
+
+	std::map<std::string, ScopeHistory> scopes_;
+	std::map<std::string, std::pair<float, int>> frame_;
+	bool recording_ = false;
+	std::vector<ProfileEvent> trace_;
+
+public:
+	static Profiler& instance() {
+		static Profiler profiler;
+		return profiler;
+	}
+
+	int64_t now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch_).count();
+	}
+
+	/**
+	 * name must live until the end of the program, a string literal.
+	 **/
+	void record(const char* name, int64_t start_nanoseconds, int64_t end_nanoseconds) {
+		thread_local ThreadRegistration registration;
+		ThreadEvents* events = registration.events();
+		if (!events->events.tryPush(ProfileEvent{ name, start_nanoseconds, end_nanoseconds, events->thread })) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void endFrame() {
+		frame_.clear();
+		{
+			std::lock_guard<std::mutex> lock(threads_mutex_);
+			for (const auto& event : exited_events_) {
+				addToFrame_(event);
+			}
+			exited_events_.clear();
+			ProfileEvent event;
+			for (auto& thread : threads_) {
+				while (thread->events.tryPop(event)) {
+					addToFrame_(event);
+				}
+			}
+		}
+		for (const auto& [name, frame] : frame_) {
+			scopes_[name];
+		}
+		for (auto& [name, history] : scopes_) {
+			const auto frame = frame_.find(name);
+			history.milliseconds[history.offset] = frame != frame_.end() ? frame->second.first : 0.f;
+			history.calls = frame != frame_.end() ? frame->second.second : 0;
+			history.offset = (history.offset + 1) % HISTORY;
+		}
+	}
+
+	const std::map<std::string, ScopeHistory>& scopes() const {
+		return scopes_;
+	}
+
+	size_t dropped() const {
+		return dropped_.load(std::memory_order_relaxed);
+	}
+
+	bool recording() const {
+		return recording_;
+	}
+
+	void setRecording(bool recording) {
+		recording_ = recording;
+	}
+
+	size_t traceSize() const {
+		return trace_.size();
+	}
+
+	void clearTrace() {
+		trace_.clear();
+	}
+
+	/**
+	 * Complete events of the trace event format, times in microseconds since the start of the program.
+	 **/
+	void writeChromeTrace(const std::string& path) const {
+		std::ofstream out(path);
+		if (!out) {
+			throw std::runtime_error("Could not open " + path);
+		}
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		for (size_t k = 0; k < trace_.size(); k++) {
+			const ProfileEvent& event = trace_[k];
+			out << "{\"name\":\"" << event.name << "\",\"cat\":\"simulation\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread
+				<< ",\"ts\":" << event.start_nanoseconds / 1000 << "." << event.start_nanoseconds / 100 % 10
+				<< ",\"dur\":" << (event.end_nanoseconds - event.start_nanoseconds) / 1000 << "." << (event.end_nanoseconds - event.start_nanoseconds) / 100 % 10
+				<< "}" << (k + 1 < trace_.size() ? ",\n" : "\n");
+		}
+		out << "]}\n";
+		if (!out) {
+			throw std::runtime_error("Could not write " + path);
+		}
+	}
+
+private:
+	Profiler() = default;
+
+	ThreadEvents* registerThread_() {
+		std::lock_guard<std::mutex> lock(threads_mutex_);
+		threads_.push_back(std::make_unique<ThreadEvents>());
+		threads_.back()->thread = next_thread_++;
+		return threads_.back().get();
+	}
+
+	/**
+	 * The events the thread has left are kept for the next frame, as long as there is room for them.
+	 **/
+	void unregisterThread_(ThreadEvents* events) {
+		std::lock_guard<std::mutex> lock(threads_mutex_);
+		ProfileEvent event;
+		while (events->events.tryPop(event)) {
+			if (exited_events_.size() < EVENTS_PER_THREAD) {
+				exited_events_.push_back(event);
+			} else {
+				dropped_.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+		threads_.erase(std::find_if(threads_.begin(), threads_.end(), [events](const auto& thread) { return thread.get() == events; }));
+	}
+
+	void addToFrame_(const ProfileEvent& event) {
+		auto& [milliseconds, calls] = frame_[event.name];
+		milliseconds += (event.end_nanoseconds - event.start_nanoseconds) * 1e-6f;
+		calls++;
+		if (recording_ && trace_.size() < MAX_TRACE_EVENTS) {
+			trace_.push_back(event);
+		}
+	}
+};
+
+class ProfileScope {
+	const char* name_;
+	int64_t start_;
+
+public:
+	explicit ProfileScope(const char* name) : name_(name), start_(Profiler::instance().now()) {}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+	~ProfileScope() {
+		Profiler& profiler = Profiler::instance();
+		profiler.record(name_, start_, profiler.now());
+	}
+};
+
+#define PROFILE_CONCATENATE_(a, b) a##b
+#define PROFILE_SCOPE_VARIABLE_(line) PROFILE_CONCATENATE_(profile_scope_, line)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_SCOPE_VARIABLE_(__LINE__)(name)
+#define PROFILE_FRAME() Profiler::instance().endFrame()
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#endif
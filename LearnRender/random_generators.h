@@ -1,17 +1,92 @@
 #pragma once
-#include <random>
+#include <array>
+#include <cstdint>
 
+/**
+ * What a random number is drawn for.
+ * Numbers drawn for the same circle and step but for different purposes are independent.
+ * The values are part of the random numbers, so a purpose keeps its value.
+ * PLACEMENT draws the four numbers of a new circle at once: position x, position y, direction x and direction y.
+ */
+enum class RandomPurpose : uint32_t {
+	PLACEMENT, RECOVERY_TIME = 4, DEATH, INFECTION, TIME_TO_REST_IN_CAGE,
+	SWEEP_PERMUTATION, SWEEP_OFFSET
+};
 
-float gen_random_float_number(float min_value, float max_value) {
-    static std::default_random_engine e;
-    std::uniform_real_distribution<> dis(min_value, max_value);
-    return dis(e);
-}
+/**
+ * Counter-based random generator (Philox4x32-10).
+ * A random number is a pure function of (seed, circle id, step, purpose, extra), so there is no state to share
+ * between threads and the result does not depend on the order in which circles are processed.
+ * The same seed and the same actions always give the same run.
+ */
+class CounterRandom {
+	uint64_t seed_{};
 
+public:
+	CounterRandom() = default;
 
+	explicit CounterRandom(uint64_t seed) : seed_(seed) {}
 
-int gen_random_integer_number(int min_value, int max_value) {
-    static std::default_random_engine e;
-    std::uniform_int_distribution<> dis(min_value, max_value);
-    return dis(e);
-}
\ No newline at end of file
+	uint64_t seed() const {
+		return seed_;
+	}
+
+	std::array<uint32_t, 4> bits(uint32_t circle_id, uint64_t step, RandomPurpose purpose, uint32_t extra = 0) const {
+		std::array<uint32_t, 4> counter = {
+			circle_id,
+			static_cast<uint32_t>(step),
+			static_cast<uint32_t>(step >> 32) ^ (static_cast<uint32_t>(purpose) << 24),
+			extra
+		};
+		uint32_t key0 = static_cast<uint32_t>(seed_);
+		uint32_t key1 = static_cast<uint32_t>(seed_ >> 32);
+		for (int round = 0; round < 10; round++) {
+			if (round > 0) {
+				key0 += 0x9E3779B9;
+				key1 += 0xBB67AE85;
+			}
+			const uint64_t product0 = static_cast<uint64_t>(0xD2511F53) * counter[0];
+			const uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57) * counter[2];
+			counter = {
+				static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key0,
+				static_cast<uint32_t>(product1),
+				static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key1,
+				static_cast<uint32_t>(product0)
+			};
+		}
+		return counter;
+	}
+
+	/**
+	 * Uniformly distributed number in [0, 1).
+	 */
+	float uniform(uint32_t circle_id, uint64_t step, RandomPurpose purpose, uint32_t extra = 0) const {
+		return toUnitFloat(bits(circle_id, step, purpose, extra)[0]);
+	}
+
+	/**
+	 * Uniformly distributed number in [min_value, max_value).
+	 */
+	float uniform(float min_value, float max_value, uint32_t circle_id, uint64_t step, RandomPurpose purpose, uint32_t extra = 0) const {
+		return min_value + (max_value - min_value) * uniform(circle_id, step, purpose, extra);
+	}
+
+	/**
+	 * Uniformly distributed integer in [min_value, max_value].
+	 */
+	int uniformInteger(int min_value, int max_value, uint32_t circle_id, uint64_t step, RandomPurpose purpose, uint32_t extra = 0) const {
+		return toInteger(bits(circle_id, step, purpose, extra)[0], min_value, max_value);
+	}
+
+	static float toUnitFloat(uint32_t value) {
+		return (value >> 8) * (1.f / 16777216.f);
+	}
+
+	/**
+	 * Integer in [min_value, max_value] from a word of bits().
+	 */
+	static int toInteger(uint32_t value, int min_value, int max_value) {
+		const uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(max_value) - min_value + 1);
+		return static_cast<int>(min_value + static_cast<int64_t>((value * range) >> 32));
+	}
+};
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <implot.h>
+
+#include "imgui_impl_glfw.h"
+#include "imgui_impl_opengl3.h"
+#include "settings.h"
+
+GLFWwindow* GLFWBeginRendering(const char* title) {
+	GLFWwindow* window;
+
+	/* Initialize the library */
+	if (!glfwInit()) {
+		puts("Could not initialize GLFW");
+		return nullptr;
+	}
+
+	//glfwWindowHint(GLFW_TRANSPARENT_FRAMEBUFFER, 1);
+	
+	/* Create a windowed mode window and its OpenGL context */
+	window = glfwCreateWindow(VIEWPORT_WIDTH, VIEWPORT_HEIGHT, title, NULL, NULL);
+	if (!window) {
+		glfwTerminate();
+		puts("Could not create GLFW window");
+		return nullptr;
+	}
+
+	/* Make the window's context current */
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(1);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		puts("Could not initialize Glad");
+		return nullptr;
+	}
+
+	return window;
+}
+
+void IMGUIBeginRendering(GLFWwindow* window) {
+	// imgui stuff
+	IMGUI_CHECKVERSION();
+	ImGui::CreateContext();
+	ImPlot::CreateContext();
+	ImGuiIO& io = ImGui::GetIO();
+
+	// Setup Dear ImGui style
+	ImGui::StyleColorsDark();
+
+	// Setup Platform/Renderer backends
+	ImGui_ImplGlfw_InitForOpenGL(window, true);
+	ImGui_ImplOpenGL3_Init();
+}
\ No newline at end of file
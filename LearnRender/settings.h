@@ -1,38 +1,20 @@
 #pragma once
 #include <string>
 
-#include "imgui.h"
-
 int VIEWPORT_WIDTH = 1680;
 int VIEWPORT_HEIGHT = 1020;
 
 float SIMULATION_SPEED = 0.0;
-
-ImColor SUSCEPTIBLE_COLOR = ImColor(255, 255, 0);
-ImColor INFECTED_COLOR = ImColor(255, 0, 0);
-ImColor DEAD_COLOR = ImColor(0, 0, 0);
-ImColor RECOVERED_COLOR = ImColor(0, 255, 0);
-
-ImColor GREEN_COLOR = ImColor(0, 255, 0);
-ImColor RED_COLOR = ImColor(255, 0, 0);
-
-
-int CAGE_FONT_SIZE = 20;
-ImColor BORDER_COLOR = ImColor(180, 180, 180);
-ImColor CAGE_NAME_COLOR = ImColor(200, 200, 20);
+// steps of one unit of time as fast as the simulation thread can make them, SIMULATION_SPEED is ignored
+bool SIMULATION_UNLIMITED_SPEED = false;
 
 int CIRCLE_COUNT = 100;
 
-float RECOVERY_TIME_MIN = 300;
-float RECOVERY_TIME_MAX = 1500;
-
-float DEATH_PROBABILITY = 0.2;
-
-float INFECTION_PROBABILITY = 0.045;
+float CIRCLE_RADIUS = 3.f;
 
-bool SHOW_DEMO_WINDOW = false;
+std::string DIRECTORY_FOR_SAVES = "saves";
 
-float TIME_TO_REST_IN_CAGE_MIN = 500;
-float TIME_TO_REST_IN_CAGE_MAX = 1500;
+int PARALLEL_CAGE_MIN_POPULATION = 20000;
 
-std::string DIRECTORY_FOR_SAVES = "saves";
\ No newline at end of file
+// cages with at least that many circles are drawn as a heatmap of the density of every stage
+int HEATMAP_MIN_CAGE_POPULATION = 50000;
\ No newline at end of file
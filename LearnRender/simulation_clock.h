@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Simulation time that moves forward only when it is told to.
+ * The headless runner advances it by a fixed step, the window by the scaled wall clock time (see SimulationThread).
+ */
+struct SimulationClock
+{
+	float current_time{};
+	uint64_t step{};
+
+	SimulationClock() = default;
+
+	SimulationClock(float start_time) : current_time(start_time) {}
+
+	void advance(float delta_time) {
+		current_time += delta_time;
+		step++;
+	}
+};
\ No newline at end of file
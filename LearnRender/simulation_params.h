@@ -0,0 +1,97 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+/**
+ *	Parameters of the disease and of the movement of one simulation.
+ *	Every Canvas has its own copy, so simulations with different parameters can run side by side in one process.
+ **/
+struct SimulationParams {
+	// probability that an infected circle infects a susceptible one it touches for one unit of time
+	float infection_probability = 0.045f;
+	float death_probability = 0.2f;
+	float recovery_time_min = 300;
+	float recovery_time_max = 1500;
+	float time_to_rest_in_cage_min = 500;
+	float time_to_rest_in_cage_max = 1500;
+
+	/**
+	 * Probability of an infection from a contact of delta_time. Infection is a hazard rate -ln(1 - infection_probability)
+	 * integrated over the contact, so a contact of one unit of time has the same chance in one step or in many short ones.
+	 **/
+	float infectionProbability(float delta_time) const {
+		return static_cast<float>(1.0 - std::pow(1.0 - infection_probability, static_cast<double>(delta_time)));
+	}
+
+	/**
+	 * Rate of infection of a susceptible circle by one infected circle it touches. A probability of 1 would be
+	 * an infinite rate, it is capped to the rate of 1 - 1e-9.
+	 **/
+	double infectionRate() const {
+		return -std::log(std::max(1e-9, 1.0 - infection_probability));
+	}
+
+	struct Field {
+		const char* name;
+		float SimulationParams::* value;
+	};
+
+	/**
+	 * Names under which the parameters are set from the command line and written to the results of a sweep.
+	 **/
+	static const std::array<Field, 6>& fields() {
+		static const std::array<Field, 6> fields = { {
+			{ "infection_probability", &SimulationParams::infection_probability },
+			{ "death_probability", &SimulationParams::death_probability },
+			{ "recovery_time_min", &SimulationParams::recovery_time_min },
+			{ "recovery_time_max", &SimulationParams::recovery_time_max },
+			{ "time_to_rest_in_cage_min", &SimulationParams::time_to_rest_in_cage_min },
+			{ "time_to_rest_in_cage_max", &SimulationParams::time_to_rest_in_cage_max },
+		} };
+		return fields;
+	}
+
+	static bool isField(const std::string& name) {
+		for (const auto& field : fields()) {
+			if (name == field.name) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Throws std::invalid_argument if there is no parameter with the name.
+	 **/
+	void set(const std::string& name, float value) {
+		this->*find_(name).value = value;
+	}
+
+	float get(const std::string& name) const {
+		return this->*find_(name).value;
+	}
+
+	/**
+	 * Throws std::invalid_argument if the parameters do not make sense together.
+	 **/
+	void validate() const {
+		if (infection_probability < 0 || infection_probability > 1 || death_probability < 0 || death_probability > 1) {
+			throw std::invalid_argument("Probabilities must be between 0 and 1");
+		}
+		if (recovery_time_min < 0 || recovery_time_min > recovery_time_max) {
+			throw std::invalid_argument("Recovery time must satisfy 0 <= min <= max");
+		}
+		if (time_to_rest_in_cage_min < 0 || time_to_rest_in_cage_min > time_to_rest_in_cage_max) {
+			throw std::invalid_argument("Time to rest in a cage must satisfy 0 <= min <= max");
+		}
+	}
+
+private:
+	static const Field& find_(const std::string& name) {
+		for (const auto& field : fields()) {
+			if (name == field.name) return field;
+		}
+		throw std::invalid_argument("There is no parameter " + name);
+	}
+};
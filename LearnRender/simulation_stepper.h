@@ -0,0 +1,45 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "cage_mediator.h"
+#include "canvas.h"
+#include "movement_kernel.h"
+#include "settings.h"
+#include "simulation_clock.h"
+
+/**
+ * Longest sub-step of the simulation. A circle moves at most MAX_AXIS_SPEED along each axis per unit of time,
+ * so two circles get closer by at most 2 * sqrt(2) * MAX_AXIS_SPEED per unit of time. In a sub-step they get closer
+ * by at most CIRCLE_RADIUS, half the interaction distance, so no contact and no cage wall is jumped over between
+ * two checks.
+ **/
+inline float maxSubstepDuration() {
+	return CIRCLE_RADIUS / (2.f * std::sqrt(2.f) * MAX_AXIS_SPEED);
+}
+
+/**
+ * Number of sub-steps advanceSimulation splits duration into, the steps of the clock it makes.
+ **/
+inline uint64_t substepCount(float duration) {
+	if (duration <= 0) return 0;
+	return std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(duration / maxSubstepDuration())));
+}
+
+/**
+ * Advance the simulation by duration in as few equal sub-steps as the speed of the circles allows.
+ * Returns the number of sub-steps; every sub-step is one step of the clock.
+ * With the default radius a sub-step is at most about half a unit of time, so a step of one unit is two sub-steps.
+ **/
+inline uint64_t advanceSimulation(CageMediator& cage_mediator, Canvas& canvas, SimulationClock& clock, float duration) {
+	const uint64_t substeps = substepCount(duration);
+	if (substeps == 0) return 0;
+	const float substep_duration = duration / substeps;
+	for (uint64_t k = 0; k < substeps; k++) {
+		clock.advance(substep_duration);
+		cage_mediator.update(clock);
+		canvas.update(clock);
+	}
+	return substeps;
+}
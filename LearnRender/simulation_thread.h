@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "cage_mediator.h"
+#include "canvas.h"
+#include "canvas_snapshot.h"
+#include "profiler.h"
+#include "settings.h"
+#include "simulation_clock.h"
+#include "simulation_stepper.h"
+#include "triple_buffer.h"
+
+/**
+ *	Runs the simulation on a thread of its own, so the speed of the model does not depend on the frame rate and a slow
+ *	frame does not stop the model.
+ *	The simulation time goes SIMULATION_SPEED times faster than the wall clock, or steps of one unit of time follow each
+ *	other as fast as possible with SIMULATION_UNLIMITED_SPEED.
+ *	After steps the thread captures a CanvasSnapshot into a triple buffer, which the render thread draws without locks.
+ *	Everything else that reads or changes the simulation, the UI controls, does it inside access(); the thread
+ *	steps in short batches and lets access() in between them.
+ **/
+class SimulationThread {
+	using Clock = std::chrono::steady_clock;
+	// the longest time the state is locked for steps, the longest an access() waits
+	static constexpr std::chrono::milliseconds BATCH_DURATION{ 5 };
+	// the time between steps when the speed allows smaller steps, about as smooth as a fast display
+	static constexpr std::chrono::microseconds STEP_INTERVAL{ 4000 };
+
+	Canvas* canvas_;
+	CageMediator* cage_mediator_;
+	SimulationClock* clock_;
+
+	std::mutex state_mutex_;
+	std::atomic<int> waiting_{};
+	TripleBuffer<CanvasSnapshot> snapshots_;
+	// the state changed since the last snapshot, guarded by state_mutex_
+	bool changed_ = true;
+
+	std::atomic<bool> stop_{};
+	std::thread thread_;
+
+public:
+	SimulationThread(Canvas& canvas, CageMediator& cage_mediator, SimulationClock& clock) :
+		canvas_(&canvas),
+		cage_mediator_(&cage_mediator),
+		clock_(&clock),
+		thread_([this] { run_(); }) {}
+
+	SimulationThread(const SimulationThread&) = delete;
+	SimulationThread& operator=(const SimulationThread&) = delete;
+
+	~SimulationThread() {
+		stop_ = true;
+		thread_.join();
+	}
+
+	/**
+	 * Call function with the simulation stopped between two steps. Waits for the current batch of steps at most.
+	 **/
+	template <typename Function>
+	void access(Function function) {
+		waiting_.fetch_add(1);
+		std::lock_guard<std::mutex> lock(state_mutex_);
+		waiting_.fetch_sub(1);
+		function();
+		changed_ = true;
+	}
+
+	/**
+	 * The last snapshot. Called by the render thread only; the snapshot stays valid until the next call.
+	 **/
+	const CanvasSnapshot& snapshot() {
+		return snapshots_.front();
+	}
+
+private:
+	void run_() {
+		auto last_time = Clock::now();
+		auto last_step_time = last_time;
+		auto rate_start = last_time;
+		uint64_t rate_steps = 0;
+		float steps_per_second = 0;
+		float pending_time = 0;
+		while (!stop_) {
+			// the mutex is not fair, a waiting access() goes first
+			while (waiting_.load() > 0) {
+				std::this_thread::yield();
+			}
+
+			bool stepped = false;
+			{
+				std::lock_guard<std::mutex> lock(state_mutex_);
+				const auto now = Clock::now();
+				const float wall_seconds = std::chrono::duration<float>(now - last_time).count();
+				last_time = now;
+				if (SIMULATION_UNLIMITED_SPEED) {
+					PROFILE_SCOPE("SimulationThread::steps");
+					pending_time = 0;
+					const auto batch_end = now + BATCH_DURATION;
+					do {
+						rate_steps += advanceSimulation(*cage_mediator_, *canvas_, *clock_, 1.f);
+					} while (Clock::now() < batch_end && waiting_.load() == 0);
+					stepped = true;
+				} else {
+					pending_time += wall_seconds * SIMULATION_SPEED;
+					if (pending_time > 0 && (pending_time >= maxSubstepDuration() || now - last_step_time >= STEP_INTERVAL)) {
+						PROFILE_SCOPE("SimulationThread::steps");
+						// a model slower than the wall clock falls behind instead of taking longer and longer batches
+						pending_time = std::min(pending_time, SIMULATION_SPEED * std::chrono::duration<float>(BATCH_DURATION).count() * 4);
+						rate_steps += advanceSimulation(*cage_mediator_, *canvas_, *clock_, pending_time);
+						pending_time = 0;
+						last_step_time = now;
+						stepped = true;
+					}
+				}
+				changed_ |= stepped;
+
+				const float rate_seconds = std::chrono::duration<float>(Clock::now() - rate_start).count();
+				if (rate_seconds >= 0.5f) {
+					const float rate = rate_steps / rate_seconds;
+					changed_ |= rate != steps_per_second;
+					steps_per_second = rate;
+					rate_steps = 0;
+					rate_start = Clock::now();
+				}
+				// a snapshot is captured only when the render thread has taken the last one
+				if (changed_ && !snapshots_.unread()) {
+					PROFILE_SCOPE("SimulationThread::snapshot");
+					CanvasSnapshot& snapshot = snapshots_.back();
+					snapshot.capture(*canvas_, *clock_, HEATMAP_MIN_CAGE_POPULATION);
+					snapshot.steps_per_second = steps_per_second;
+					snapshots_.publish();
+					changed_ = false;
+				}
+			}
+			if (!stepped) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+	}
+};
@@ -0,0 +1,149 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <glm/vec2.hpp>
+
+#include "util.h"
+
+/**
+ *	Uniform grid (cell list) over a rectangular area.
+ *	The cell size is equal to the interaction distance, so every item that can intersect a given point
+ *	lies either in the cell of that point or in one of the eight neighbouring cells.
+ *	The grid is rebuilt from scratch with a counting sort, which is linear in the number of items.
+ *	Points outside the area are clamped to the border cells, so items that left the area are still found.
+ **/
+class SpatialGrid {
+	glm::vec2 origin_{};
+	float inverse_cell_size_ = 1.f;
+	int columns_ = 1;
+	int rows_ = 1;
+	std::vector<int> cell_start_;
+	std::vector<int> cursor_;
+	std::vector<int> item_cells_;
+	std::vector<uint32_t> items_;
+
+public:
+	void reset(const Coordinates& area, float cell_size) {
+		origin_ = area.top_left_corner;
+		inverse_cell_size_ = 1.f / cell_size;
+		columns_ = std::max(1, static_cast<int>(area.width * inverse_cell_size_) + 1);
+		rows_ = std::max(1, static_cast<int>(area.height * inverse_cell_size_) + 1);
+		cell_start_.assign(static_cast<size_t>(columns_) * rows_ + 1, 0);
+		item_cells_.clear();
+		items_.clear();
+	}
+
+	/**
+	 * Rebuild the grid for items 0..count-1, position(i) must return the center of the item i.
+	 **/
+	template <typename Position>
+	void build(size_t count, Position position) {
+		std::fill(cell_start_.begin(), cell_start_.end(), 0);
+		item_cells_.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			const int cell = cellIndex(position(i));
+			item_cells_[i] = cell;
+			cell_start_[cell + 1]++;
+		}
+		for (size_t i = 1; i < cell_start_.size(); i++) {
+			cell_start_[i] += cell_start_[i - 1];
+		}
+
+		items_.resize(count);
+		cursor_.assign(cell_start_.begin(), cell_start_.end() - 1);
+		for (size_t i = 0; i < count; i++) {
+			items_[cursor_[item_cells_[i]]++] = static_cast<uint32_t>(i);
+		}
+	}
+
+	/**
+	 * Call visit(item) for every item in the cell of the point and in the neighbouring cells.
+	 **/
+	template <typename Visitor>
+	void forEachNeighbour(glm::vec2 point, Visitor visit) const {
+		const int column = cellColumn_(point.x);
+		const int row = cellRow_(point.y);
+		for (int r = std::max(0, row - 1); r <= std::min(rows_ - 1, row + 1); r++) {
+			const int first = r * columns_ + std::max(0, column - 1);
+			const int last = r * columns_ + std::min(columns_ - 1, column + 1);
+			for (int k = cell_start_[first]; k < cell_start_[last + 1]; k++) {
+				visit(items_[k]);
+			}
+		}
+	}
+
+	/**
+	 * Call visit(cell) for the cell of the point and for the neighbouring cells.
+	 **/
+	template <typename Visitor>
+	void forEachNeighbourCell(glm::vec2 point, Visitor visit) const {
+		const int column = cellColumn_(point.x);
+		const int row = cellRow_(point.y);
+		for (int r = std::max(0, row - 1); r <= std::min(rows_ - 1, row + 1); r++) {
+			for (int c = std::max(0, column - 1); c <= std::min(columns_ - 1, column + 1); c++) {
+				visit(r * columns_ + c);
+			}
+		}
+	}
+
+	/**
+	 * Call visit(item, cell) for every item in the rows [first_row, last_row).
+	 * Bands of rows do not share items, so they can be processed by different threads.
+	 **/
+	template <typename Visitor>
+	void forEachItemInRows(int first_row, int last_row, Visitor visit) const {
+		for (int cell = first_row * columns_; cell < last_row * columns_; cell++) {
+			for (int k = cell_start_[cell]; k < cell_start_[cell + 1]; k++) {
+				visit(items_[k], cell);
+			}
+		}
+	}
+
+	/**
+	 * Cell of a point, clamped to the area.
+	 **/
+	int cellIndex(glm::vec2 point) const {
+		return cellRow_(point.y) * columns_ + cellColumn_(point.x);
+	}
+
+	/**
+	 * Cell of the item i at the last build, valid while i < itemCount().
+	 **/
+	int itemCell(size_t i) const {
+		return item_cells_[i];
+	}
+
+	size_t itemCount() const {
+		return item_cells_.size();
+	}
+
+	glm::vec2 origin() const {
+		return origin_;
+	}
+
+	float cellSize() const {
+		return 1.f / inverse_cell_size_;
+	}
+
+	int columns() const {
+		return columns_;
+	}
+
+	int rows() const {
+		return rows_;
+	}
+
+	size_t cellCount() const {
+		return static_cast<size_t>(columns_) * rows_;
+	}
+
+private:
+	int cellColumn_(float x) const {
+		return std::clamp(static_cast<int>((x - origin_.x) * inverse_cell_size_), 0, columns_ - 1);
+	}
+
+	int cellRow_(float y) const {
+		return std::clamp(static_cast<int>((y - origin_.y) * inverse_cell_size_), 0, rows_ - 1);
+	}
+};
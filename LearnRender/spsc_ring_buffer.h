@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ *	Bounded lock-free queue for exactly one producer thread and one consumer thread.
+ *	Neither side ever waits: tryPush fails when the queue is full and tryPop fails when it is empty.
+ *	The capacity is rounded up to a power of two.
+ **/
+template <typename T>
+class SpscRingBuffer {
+	// keep the indices on different cache lines, each is written by one thread only
+	alignas(64) std::atomic<size_t> head_{};
+	alignas(64) std::atomic<size_t> tail_{};
+	alignas(64) size_t mask_;
+	std::vector<T> items_;
+
+public:
+	explicit SpscRingBuffer(size_t capacity) {
+		size_t size = 1;
+		while (size < capacity) {
+			size *= 2;
+		}
+		mask_ = size - 1;
+		items_.resize(size);
+	}
+
+	SpscRingBuffer(const SpscRingBuffer&) = delete;
+	SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+	/**
+	 * Called by the producer only.
+	 **/
+	bool tryPush(const T& item) {
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - head_.load(std::memory_order_acquire) > mask_) return false;
+		items_[tail & mask_] = item;
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Called by the consumer only.
+	 **/
+	bool tryPop(T& item) {
+		const size_t head = head_.load(std::memory_order_relaxed);
+		if (head == tail_.load(std::memory_order_acquire)) return false;
+		item = items_[head & mask_];
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t capacity() const {
+		return mask_ + 1;
+	}
+};
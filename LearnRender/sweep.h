@@ -0,0 +1,239 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cage_mediator.h"
+#include "canvas.h"
+#include "random_generators.h"
+#include "simulation_clock.h"
+#include "simulation_params.h"
+#include "simulation_stepper.h"
+#include "thread_pool.h"
+
+/**
+ *	Range of one parameter of a sweep. A grid takes points evenly spaced values from min to max,
+ *	a Latin hypercube ignores points and samples the range.
+ **/
+struct SweepAxis {
+	std::string parameter;
+	float min{};
+	float max{};
+	size_t points = 2;
+};
+
+enum class SweepDesign {
+	GRID, LATIN_HYPERCUBE
+};
+
+struct SweepOptions {
+	std::string save_file;
+	// parameters that are not on an axis
+	SimulationParams base_params;
+	std::vector<SweepAxis> axes;
+	SweepDesign design = SweepDesign::GRID;
+	// number of configurations of a Latin hypercube
+	size_t samples = 100;
+	// runs of every configuration, run r has the seed first_seed + r
+	size_t replicas = 1;
+	uint64_t first_seed{};
+	uint64_t steps = 1000;
+	float step_duration = 1.f;
+	// cage name and number of circles to infect before the run
+	std::vector<std::pair<std::string, int>> infected;
+};
+
+/**
+ *	One run of a sweep: a configuration of parameters with one seed.
+ **/
+struct SweepJob {
+	size_t configuration{};
+	size_t replica{};
+	uint64_t seed{};
+	SimulationParams params;
+};
+
+struct SweepResult {
+	SweepJob job;
+	DiseaseTotals totals;
+	int peak_infected{};
+	float peak_time{};
+};
+
+/**
+ *	Expands the axes into configurations of parameters and runs every configuration replicas times.
+ *	Runs are independent and scheduled on the thread pool one run per task, each run is single-threaded.
+ *	The configurations are checked before anything runs, so a bad range fails at once and not after hours.
+ *	Results are reported in the order of the jobs whatever order they finish in, and are the same for any number of threads.
+ **/
+class SweepEngine {
+	SweepOptions options_;
+	std::vector<SweepJob> jobs_;
+
+public:
+	explicit SweepEngine(SweepOptions options) : options_(std::move(options)) {
+		if (options_.replicas == 0 || options_.steps == 0 || options_.step_duration <= 0) {
+			throw std::invalid_argument("Sweep needs at least one replica, one step and a positive step");
+		}
+		if (options_.design == SweepDesign::LATIN_HYPERCUBE && options_.samples == 0) {
+			throw std::invalid_argument("Latin hypercube needs at least one sample");
+		}
+		for (const auto& axis : options_.axes) {
+			if (!SimulationParams::isField(axis.parameter)) {
+				throw std::invalid_argument("There is no parameter " + axis.parameter);
+			}
+			if (axis.min > axis.max || (options_.design == SweepDesign::GRID && axis.points == 0)) {
+				throw std::invalid_argument("Range of " + axis.parameter + " is empty");
+			}
+		}
+		const std::vector<SimulationParams> configurations = expand_();
+		for (size_t c = 0; c < configurations.size(); c++) {
+			try {
+				configurations[c].validate();
+			} catch (const std::invalid_argument& e) {
+				throw std::invalid_argument("Configuration " + std::to_string(c) + ": " + e.what());
+			}
+			for (size_t r = 0; r < options_.replicas; r++) {
+				jobs_.push_back(SweepJob{ c, r, options_.first_seed + r, configurations[c] });
+			}
+		}
+	}
+
+	const std::vector<SweepJob>& jobs() const {
+		return jobs_;
+	}
+
+	/**
+	 * on_result is called once for every job, in the order of the jobs, on one of the threads of the pool
+	 * and never on two threads at once. Jobs that have not started when cancel becomes true are skipped.
+	 **/
+	void run(ThreadPool& pool, const std::function<void(const SweepResult&)>& on_result, const std::atomic<bool>* cancel = nullptr) {
+		std::mutex mutex;
+		std::vector<SweepResult> results(jobs_.size());
+		std::vector<uint8_t> finished(jobs_.size());
+		size_t next_to_report = 0;
+		pool.parallelFor(jobs_.size(), [&](size_t j, size_t) {
+			if (cancel && *cancel) return;
+			SweepResult result = runJob_(jobs_[j]);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			results[j] = result;
+			finished[j] = 1;
+			while (next_to_report < jobs_.size() && finished[next_to_report]) {
+				on_result(results[next_to_report++]);
+			}
+		});
+	}
+
+	/**
+	 * Header of the results table: the job, every parameter and the outcome of the run.
+	 **/
+	static void writeHeader(std::ostream& out) {
+		out << "configuration,replica,seed";
+		for (const auto& field : SimulationParams::fields()) {
+			out << "," << field.name;
+		}
+		out << ",susceptible,infected,recovered,dead,peak_infected,peak_time\n";
+	}
+
+	static void writeRow(std::ostream& out, const SweepResult& result) {
+		out << result.job.configuration << "," << result.job.replica << "," << result.job.seed;
+		for (const auto& field : SimulationParams::fields()) {
+			out << "," << result.job.params.*field.value;
+		}
+		out << "," << result.totals.susceptible << "," << result.totals.infected << "," << result.totals.recovered << "," << result.totals.dead
+			<< "," << result.peak_infected << "," << result.peak_time << "\n";
+	}
+
+private:
+	std::vector<SimulationParams> expand_() const {
+		if (options_.axes.empty()) {
+			return { options_.base_params };
+		}
+		return options_.design == SweepDesign::GRID ? expandGrid_() : expandLatinHypercube_();
+	}
+
+	/**
+	 * Every combination of the values of the axes, the last axis changes fastest.
+	 **/
+	std::vector<SimulationParams> expandGrid_() const {
+		size_t count = 1;
+		for (const auto& axis : options_.axes) {
+			count *= axis.points;
+		}
+		std::vector<SimulationParams> configurations(count, options_.base_params);
+		for (size_t c = 0; c < count; c++) {
+			size_t rest = c;
+			for (size_t a = options_.axes.size(); a-- > 0;) {
+				const SweepAxis& axis = options_.axes[a];
+				const size_t point = rest % axis.points;
+				rest /= axis.points;
+				const float fraction = axis.points > 1 ? static_cast<float>(point) / (axis.points - 1) : 0.f;
+				configurations[c].set(axis.parameter, axis.min + (axis.max - axis.min) * fraction);
+			}
+		}
+		return configurations;
+	}
+
+	/**
+	 * samples configurations; the range of every axis is split into samples equal strata and every stratum
+	 * is used by exactly one configuration. Random numbers come from first_seed, so the design is reproducible.
+	 **/
+	std::vector<SimulationParams> expandLatinHypercube_() const {
+		const size_t samples = options_.samples;
+		const CounterRandom random(options_.first_seed);
+		std::vector<SimulationParams> configurations(samples, options_.base_params);
+		std::vector<uint32_t> strata(samples);
+		for (size_t a = 0; a < options_.axes.size(); a++) {
+			const SweepAxis& axis = options_.axes[a];
+			std::iota(strata.begin(), strata.end(), 0);
+			for (size_t k = samples; k-- > 1;) {
+				const int other = random.uniformInteger(0, static_cast<int>(k), static_cast<uint32_t>(k), a, RandomPurpose::SWEEP_PERMUTATION);
+				std::swap(strata[k], strata[other]);
+			}
+			for (size_t s = 0; s < samples; s++) {
+				const float offset = random.uniform(static_cast<uint32_t>(s), a, RandomPurpose::SWEEP_OFFSET);
+				const float fraction = (strata[s] + offset) / samples;
+				configurations[s].set(axis.parameter, std::min(axis.max, axis.min + (axis.max - axis.min) * fraction));
+			}
+		}
+		return configurations;
+	}
+
+	SweepResult runJob_(const SweepJob& job) const {
+		Canvas canvas(glm::vec2(0, 0), VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
+		CageMediator cage_mediator(&canvas);
+		SimulationClock clock;
+		canvas.setSeed(job.seed);
+		canvas.setParams(job.params);
+		canvas.getGraphData().continue_drawing = false;
+		cage_mediator.load(options_.save_file);
+		for (const auto& [cage_name, number_of_infected] : options_.infected) {
+			const CageId cage_id = canvas.findCageId(cage_name);
+			if (cage_id == NO_CAGE) {
+				throw std::invalid_argument("There is no cage " + cage_name + " in " + options_.save_file);
+			}
+			canvas.populateInfected(cage_id, number_of_infected, clock.current_time);
+		}
+
+		SweepResult result;
+		result.job = job;
+		for (uint64_t step = 0; step < options_.steps; step++) {
+			advanceSimulation(cage_mediator, canvas, clock, options_.step_duration);
+			if (canvas.getTotals().infected > result.peak_infected) {
+				result.peak_infected = canvas.getTotals().infected;
+				result.peak_time = clock.current_time;
+			}
+		}
+		result.totals = canvas.getTotals();
+		return result;
+	}
+};
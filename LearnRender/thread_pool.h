@@ -0,0 +1,205 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ *	Work-stealing thread pool.
+ *	Every worker has its own deque of tasks: it takes tasks from the back of its deque and, when the deque is empty,
+ *	steals from the front of the others. Threads that are not workers of the pool share one more deque.
+ *	A thread that waits in parallelFor runs tasks itself, so parallelFor can be called from inside a task.
+ *	A thread that is not a worker runs only its own tasks, so the worker index passed to a task is never used
+ *	by two threads at the same time for the same call.
+ **/
+class ThreadPool {
+	struct TaskGroup {
+		std::atomic<size_t> pending{};
+		std::mutex error_mutex;
+		std::exception_ptr error;
+	};
+
+	struct Task {
+		std::function<void(size_t)> function;
+		TaskGroup* group;
+	};
+
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<TaskQueue>> queues_;
+	std::vector<std::thread> workers_;
+	std::atomic<size_t> queued_{};
+	std::atomic<bool> stop_{};
+	std::mutex sleep_mutex_;
+	std::condition_variable wake_up_;
+
+	inline static thread_local const ThreadPool* current_pool_ = nullptr;
+	inline static thread_local size_t current_worker_ = 0;
+
+public:
+	/**
+	 * threads is the number of threads that run tasks, including the thread that calls parallelFor.
+	 **/
+	explicit ThreadPool(size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+		const size_t workers = threads > 1 ? threads - 1 : 0;
+		for (size_t i = 0; i <= workers; i++) {
+			queues_.push_back(std::make_unique<TaskQueue>());
+		}
+		for (size_t i = 0; i < workers; i++) {
+			workers_.emplace_back([this, i]() { workerLoop_(i); });
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+			stop_ = true;
+		}
+		wake_up_.notify_all();
+		for (auto& worker : workers_) {
+			worker.join();
+		}
+	}
+
+	/**
+	 * Number of threads that can run tasks at the same time.
+	 * The worker index passed to tasks is always less than this number.
+	 **/
+	size_t concurrency() const {
+		return queues_.size();
+	}
+
+	/**
+	 * Call function(i, worker) for every i in [0, count) and wait until all calls are finished.
+	 * Indices are grouped into chunks of grain_size. The first exception thrown by the function is rethrown here.
+	 **/
+	template <typename Function>
+	void parallelFor(size_t count, Function function, size_t grain_size = 1) {
+		if (count == 0) return;
+		grain_size = std::max<size_t>(1, grain_size);
+		const size_t own_queue = currentQueue_();
+		if (workers_.empty() || count <= grain_size) {
+			for (size_t i = 0; i < count; i++) {
+				function(i, own_queue);
+			}
+			return;
+		}
+
+		TaskGroup group;
+		const size_t chunks = (count + grain_size - 1) / grain_size;
+		group.pending = chunks;
+		{
+			std::lock_guard<std::mutex> lock(queues_[own_queue]->mutex);
+			for (size_t chunk = 0; chunk < chunks; chunk++) {
+				const size_t begin = chunk * grain_size;
+				const size_t end = std::min(count, begin + grain_size);
+				queues_[own_queue]->tasks.push_back(Task{
+					[&function, begin, end](size_t worker) {
+						for (size_t i = begin; i < end; i++) {
+							function(i, worker);
+						}
+					},
+					&group
+				});
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+			queued_ += chunks;
+		}
+		wake_up_.notify_all();
+
+		const bool is_worker = current_pool_ == this;
+		while (group.pending > 0) {
+			if (!(is_worker ? runTask_(own_queue) : runGroupTask_(own_queue, group))) {
+				std::this_thread::yield();
+			}
+		}
+		if (group.error) {
+			std::rethrow_exception(group.error);
+		}
+	}
+
+private:
+	size_t currentQueue_() const {
+		return current_pool_ == this ? current_worker_ : queues_.size() - 1;
+	}
+
+	void workerLoop_(size_t index) {
+		current_pool_ = this;
+		current_worker_ = index;
+		while (!stop_) {
+			if (runTask_(index)) continue;
+			std::unique_lock<std::mutex> lock(sleep_mutex_);
+			wake_up_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+		}
+	}
+
+	bool popTask_(size_t index, Task& task) {
+		{
+			TaskQueue& own = *queues_[index];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty()) {
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		for (size_t k = 1; k < queues_.size(); k++) {
+			TaskQueue& victim = *queues_[(index + k) % queues_.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool runTask_(size_t index) {
+		Task task;
+		if (!popTask_(index, task)) return false;
+		execute_(task, index);
+		return true;
+	}
+
+	bool runGroupTask_(size_t index, const TaskGroup& group) {
+		Task task;
+		{
+			TaskQueue& own = *queues_[index];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			auto it = std::find_if(own.tasks.rbegin(), own.tasks.rend(), [&group](const Task& t) { return t.group == &group; });
+			if (it == own.tasks.rend()) return false;
+			task = std::move(*it);
+			own.tasks.erase(std::next(it).base());
+		}
+		execute_(task, index);
+		return true;
+	}
+
+	void execute_(Task& task, size_t index) {
+		queued_--;
+		try {
+			task.function(index);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(task.group->error_mutex);
+			if (!task.group->error) {
+				task.group->error = std::current_exception();
+			}
+		}
+		task.group->pending--;
+	}
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <vector>
+
+/**
+ *	Time series of several values with bounded memory.
+ *	Recent samples are kept as they are; older ones are merged into buckets that keep the minimum and the maximum
+ *	of every value. Level 0 holds single samples, every next level holds older buckets that are factor times wider.
+ *	When the last level is full its neighbouring buckets are merged in pairs and it becomes twice as coarse, so memory
+ *	stays bounded by about levels * level_capacity buckets however long the run is.
+ **/
+template <size_t Channels>
+class TieredTimeSeries {
+public:
+	struct Bucket {
+		float begin_time{};
+		float end_time{};
+		std::array<float, Channels> min{};
+		std::array<float, Channels> max{};
+
+		void merge(const Bucket& next) {
+			end_time = next.end_time;
+			for (size_t c = 0; c < Channels; c++) {
+				min[c] = std::min(min[c], next.min[c]);
+				max[c] = std::max(max[c], next.max[c]);
+			}
+		}
+	};
+
+private:
+	size_t level_capacity_;
+	size_t factor_;
+	std::vector<std::deque<Bucket>> levels_;
+	// number of samples in one bucket of the level
+	std::vector<size_t> spans_;
+	// buckets that are not yet wide enough for the last level are merged here
+	Bucket pending_{};
+	size_t pending_span_{};
+
+public:
+	explicit TieredTimeSeries(size_t level_capacity = 2048, size_t levels = 8, size_t factor = 4) :
+		level_capacity_(std::max<size_t>(2, level_capacity)),
+		factor_(std::max<size_t>(2, factor)),
+		levels_(std::max<size_t>(1, levels)) {
+		resetSpans_();
+	}
+
+	void push(float time, const std::array<float, Channels>& values) {
+		levels_[0].push_back(Bucket{ time, time, values, values });
+		for (size_t k = 0; k + 2 < levels_.size(); k++) {
+			while (levels_[k].size() >= level_capacity_ + factor_) {
+				levels_[k + 1].push_back(popMerged_(levels_[k], factor_));
+			}
+		}
+		if (levels_.size() > 1) {
+			const size_t k = levels_.size() - 2;
+			while (levels_[k].size() >= level_capacity_ + factor_) {
+				const Bucket bucket = popMerged_(levels_[k], factor_);
+				if (pending_span_ == 0) {
+					pending_ = bucket;
+				} else {
+					pending_.merge(bucket);
+				}
+				pending_span_ += spans_[k] * factor_;
+				if (pending_span_ >= spans_.back()) {
+					levels_.back().push_back(pending_);
+					pending_span_ = 0;
+				}
+			}
+		}
+		auto& last = levels_.back();
+		if (last.size() >= level_capacity_ + factor_) {
+			std::deque<Bucket> compacted;
+			while (!last.empty()) {
+				compacted.push_back(popMerged_(last, 2));
+			}
+			last.swap(compacted);
+			spans_.back() *= 2;
+		}
+	}
+
+	void clear() {
+		for (auto& level : levels_) {
+			level.clear();
+		}
+		pending_span_ = 0;
+		resetSpans_();
+	}
+
+	bool empty() const {
+		return levels_[0].empty();
+	}
+
+	/**
+	 * Number of buckets kept in memory.
+	 **/
+	size_t bucketCount() const {
+		size_t count = pending_span_ > 0 ? 1 : 0;
+		for (const auto& level : levels_) {
+			count += level.size();
+		}
+		return count;
+	}
+
+	/**
+	 * Call visit(bucket) from the oldest bucket to the newest one, merging buckets so that there are
+	 * at most about max_buckets of them. The finest resolution that fits is used for the whole series.
+	 **/
+	template <typename Visitor>
+	void forEachBucket(size_t max_buckets, Visitor visit) const {
+		max_buckets = std::max<size_t>(1, max_buckets);
+		size_t span = 0;
+		for (size_t k = 0; k < levels_.size() && span == 0; k++) {
+			if (bucketsWithSpan_(spans_[k]) <= max_buckets) {
+				span = spans_[k];
+			}
+		}
+		if (span == 0) {
+			const size_t coarsest = bucketsWithSpan_(spans_.back());
+			span = spans_.back() * ((coarsest + max_buckets - 1) / max_buckets);
+		}
+
+		for (size_t k = levels_.size(); k-- > 0;) {
+			const size_t group = std::max<size_t>(1, span / spans_[k]);
+			const auto& level = levels_[k];
+			for (size_t i = 0; i < level.size(); i += group) {
+				Bucket bucket = level[i];
+				for (size_t j = i + 1; j < std::min(level.size(), i + group); j++) {
+					bucket.merge(level[j]);
+				}
+				visit(bucket);
+			}
+			if (k + 1 == levels_.size() && k > 0 && pending_span_ > 0) {
+				visit(pending_);
+			}
+		}
+	}
+
+private:
+	void resetSpans_() {
+		spans_.assign(levels_.size(), 1);
+		for (size_t k = 1; k < spans_.size(); k++) {
+			spans_[k] = spans_[k - 1] * factor_;
+		}
+	}
+
+	size_t bucketsWithSpan_(size_t span) const {
+		size_t count = 0;
+		for (size_t k = 0; k < levels_.size(); k++) {
+			const size_t group = std::max<size_t>(1, span / spans_[k]);
+			count += (levels_[k].size() + group - 1) / group;
+		}
+		return count + (pending_span_ > 0 ? 1 : 0);
+	}
+
+	static Bucket popMerged_(std::deque<Bucket>& level, size_t count) {
+		Bucket bucket = level.front();
+		level.pop_front();
+		for (size_t i = 1; i < count && !level.empty(); i++) {
+			bucket.merge(level.front());
+			level.pop_front();
+		}
+		return bucket;
+	}
+};
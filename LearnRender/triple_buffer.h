@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ *	Three buffers shared by one writer thread and one reader thread without locks.
+ *	The writer fills back() and publishes it; the reader takes the last published buffer with front().
+ *	Neither side ever waits, the writer may publish faster than the reader reads, and the buffers are reused,
+ *	so their memory is allocated once.
+ **/
+template <typename T>
+class TripleBuffer {
+	// set in middle_ when the buffer there was published after the reader took the last one
+	static constexpr uint8_t FRESH = 4;
+	static constexpr uint8_t INDEX = 3;
+
+	std::array<T, 3> buffers_;
+	// written by the writer only
+	uint8_t back_ = 0;
+	alignas(64) std::atomic<uint8_t> middle_{ 1 };
+	// written by the reader only
+	alignas(64) uint8_t front_ = 2;
+
+public:
+	/**
+	 * Called by the writer only.
+	 **/
+	T& back() {
+		return buffers_[back_];
+	}
+
+	/**
+	 * Called by the writer only: back() becomes the last published buffer and a new back() is given.
+	 **/
+	void publish() {
+		back_ = middle_.exchange(static_cast<uint8_t>(back_ | FRESH), std::memory_order_acq_rel) & INDEX;
+	}
+
+	/**
+	 * True if the reader has not taken the last published buffer yet.
+	 **/
+	bool unread() const {
+		return middle_.load(std::memory_order_acquire) & FRESH;
+	}
+
+	/**
+	 * Called by the reader only. The buffer stays the same until the next call.
+	 **/
+	const T& front() {
+		if (middle_.load(std::memory_order_relaxed) & FRESH) {
+			front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+		}
+		return buffers_[front_];
+	}
+};
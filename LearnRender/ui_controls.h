@@ -1,30 +1,67 @@
 #pragma once
 
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <implot.h>
 
 #include "canvas.h"
 #include "cage_mediator.h"
+#include "checkpoint.h"
+#include "ensemble.h"
+#include "metapopulation_model.h"
+#include "metrics_exporter.h"
+#include "profiler.h"
+#include "simulation_clock.h"
+#include "simulation_thread.h"
+#include "ui_settings.h"
 
 enum class UserInputMessage {
-	WRONG_POPULATION_SIZE, EMPTY_NAME, REPEATED_NAME, INVALID_COORDINATES, OVERLAPPING, SUCCESS, INITIAL, DUPLICATED_NAME, FLOW_BIGGER_THAN_CAPABILITY, SAVE_CREATED
+	WRONG_POPULATION_SIZE, EMPTY_NAME, REPEATED_NAME, INVALID_COORDINATES, OVERLAPPING, SUCCESS, INITIAL, DUPLICATED_NAME, FLOW_BIGGER_THAN_CAPABILITY, SAVE_CREATED, UNKNOWN_CAGE, FILE_ERROR
 };
 
+/**
+ *	Windows of the controls. They are drawn from the snapshot of the simulation; the simulation is read or changed
+ *	only inside SimulationThread::access(), when the user does something, so drawing them never waits for steps.
+ **/
 class UIControls {
+	SimulationThread* simulation_;
 	Canvas* canvas_;
 	CageMediator* cage_mediator_;
+	SimulationClock* clock_;
+	MetricsExporter* metrics_exporter_;
+	EnsembleTask ensemble_task_;
+	EnsembleBands ensemble_bands_;
+	OdeSeries ode_preview_;
+	// the parameters being edited; only the controls change the parameters of the canvas
+	SimulationParams params_;
 	inline static UserInputMessage add_cage_state_ = UserInputMessage::INITIAL;
 	inline static UserInputMessage add_flow_state_ = UserInputMessage::INITIAL;
 	inline static UserInputMessage save_ = UserInputMessage::INITIAL;
+	inline static UserInputMessage load_ = UserInputMessage::INITIAL;
 	inline static std::string file_name_;
+	inline static std::string error_;
+	inline static std::string loaded_file_;
 public:
 
-	UIControls(Canvas& canvas, CageMediator& cage_mediator) : canvas_(&canvas), cage_mediator_(&cage_mediator) {}
+	UIControls(SimulationThread& simulation, Canvas& canvas, CageMediator& cage_mediator, SimulationClock& clock, MetricsExporter& metrics_exporter) :
+		simulation_(&simulation),
+		canvas_(&canvas),
+		cage_mediator_(&cage_mediator),
+		clock_(&clock),
+		metrics_exporter_(&metrics_exporter) {
+		simulation_->access([this] { params_ = canvas_->getParams(); });
+	}
 
-	void update(float scaled_current_time) {
+	void update(const CanvasSnapshot& snapshot) {
 		if (ImGui::Begin("Configuration")) {
-			ImGui::SliderFloat("Simulation speed", &SIMULATION_SPEED, 0.f, 100.f);
+			manageSimulationSettings_();
+			manageMetricsExport();
+			if (ImGui::CollapsingHeader("Disease parameters")) {
+				manageParams();
+			}
 			if (ImGui::CollapsingHeader("Cage configuration")) {
-				manageCageControls(scaled_current_time);
+				manageCageControls(snapshot);
 				manageAddCageButton();
 				manageAddFlowButton();
 			}
@@ -37,7 +74,11 @@ public:
 			ImGui::End();
 		}
 
-		canvas_->getGraphData().drawData();
+		drawGraph_(snapshot);
+		drawEnsemble_();
+#if SIMULATION_PROFILER
+		drawProfiler_();
+#endif
 
 		if (SHOW_DEMO_WINDOW) {
 			//ImPlot::ShowDemoWindow();
@@ -47,6 +88,259 @@ public:
 
 private:
 
+	/**
+	 * Speed of the simulation and what it is drawn like; the simulation thread reads them, so they change inside access().
+	 **/
+	void manageSimulationSettings_() {
+		float speed = SIMULATION_SPEED;
+		bool unlimited_speed = SIMULATION_UNLIMITED_SPEED;
+		int heatmap_min_cage_population = HEATMAP_MIN_CAGE_POPULATION;
+		bool changed = ImGui::SliderFloat("Simulation speed", &speed, 0.f, 100.f);
+		changed |= ImGui::Checkbox("As fast as possible", &unlimited_speed);
+		changed |= ImGui::InputInt("Heatmap from circles in a cage", &heatmap_min_cage_population, 1000, 10000);
+		if (changed) {
+			simulation_->access([&] {
+				SIMULATION_SPEED = speed;
+				SIMULATION_UNLIMITED_SPEED = unlimited_speed;
+				HEATMAP_MIN_CAGE_POPULATION = heatmap_min_cage_population;
+			});
+		}
+	}
+
+	void drawGraph_(const CanvasSnapshot& snapshot) {
+		ImGui::Begin("Graph");
+		bool continue_drawing = snapshot.continue_drawing;
+		if (ImGui::Checkbox("Continue drawing", &continue_drawing)) {
+			simulation_->access([this, continue_drawing] { canvas_->getGraphData().continue_drawing = continue_drawing; });
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear graph")) {
+			simulation_->access([this] { canvas_->getGraphData().clearGraphData(); });
+			ode_preview_.clear();
+		}
+		manageOdePreview_();
+		static ImPlotAxisFlags xflags = ImPlotAxisFlags_AutoFit | ImPlotAxisFlags_RangeFit;
+		static ImPlotAxisFlags yflags = ImPlotAxisFlags_AutoFit | ImPlotAxisFlags_RangeFit;
+		if (ImPlot::BeginPlot("My Plot", "time", "people", ImVec2(700, 400), 0, xflags, yflags)) {
+			const GraphData::View& view = snapshot.graph;
+			const int count = static_cast<int>(view.time.size());
+			ImPlot::PlotLine("Susceptible", view.time.data(), view.susceptible.data(), count);
+			ImPlot::PlotLine("Infected", view.time.data(), view.infected.data(), count);
+			ImPlot::PlotLine("Recovered", view.time.data(), view.recovered.data(), count);
+			ImPlot::PlotLine("Dead", view.time.data(), view.dead.data(), count);
+			const int preview_count = static_cast<int>(ode_preview_.time.size());
+			if (preview_count > 0) {
+				ImPlot::PlotLine("Susceptible (ODE)", ode_preview_.time.data(), ode_preview_.susceptible.data(), preview_count);
+				ImPlot::PlotLine("Infected (ODE)", ode_preview_.time.data(), ode_preview_.infected.data(), preview_count);
+				ImPlot::PlotLine("Recovered (ODE)", ode_preview_.time.data(), ode_preview_.recovered.data(), preview_count);
+				ImPlot::PlotLine("Dead (ODE)", ode_preview_.time.data(), ode_preview_.dead.data(), preview_count);
+			}
+			ImPlot::EndPlot();
+		}
+		ImGui::End();
+	}
+
+	/**
+	 * Deterministic model of the canvas from its current state, drawn over the graph for comparison.
+	 **/
+	void manageOdePreview_() {
+		static float preview_duration = 3000;
+		ImGui::SameLine();
+		const bool preview = ImGui::Button("ODE preview");
+		ImGui::SameLine();
+		ImGui::PushItemWidth(100);
+		ImGui::InputFloat("for time", &preview_duration, 0.f, 0.f, "%.0f");
+		ImGui::PopItemWidth();
+		if (preview && preview_duration > 0) {
+			// the model takes its state from the circles, the integration does not need the simulation
+			std::unique_ptr<MetapopulationModel> model;
+			float start_time = 0;
+			simulation_->access([&] {
+				model = std::make_unique<MetapopulationModel>(*canvas_);
+				start_time = clock_->current_time;
+			});
+			ode_preview_ = model->integrate(start_time, preview_duration, std::max(1.f, preview_duration / 1000));
+		}
+	}
+
+	void manageMetricsExport() {
+		static bool export_metrics = false;
+		if (ImGui::Checkbox("Export metrics", &export_metrics)) {
+			if (export_metrics) {
+				std::filesystem::create_directory(DIRECTORY_FOR_SAVES);
+			}
+			simulation_->access([this] { canvas_->setMetricsExporter(export_metrics ? metrics_exporter_ : nullptr); });
+		}
+		if (metrics_exporter_->failed()) {
+			ImGui::TextColored(RED_COLOR, "%s", metrics_exporter_->error().c_str());
+		}
+	}
+
+	void manageParams() {
+		SimulationParams params = params_;
+		bool changed = false;
+		changed |= ImGui::SliderFloat("Infection probability", &params.infection_probability, 0.f, 1.f);
+		changed |= ImGui::SliderFloat("Death probability", &params.death_probability, 0.f, 1.f);
+		changed |= ImGui::DragFloatRange2("Recovery time", &params.recovery_time_min, &params.recovery_time_max, 10.f, 0.f, 10000.f);
+		changed |= ImGui::DragFloatRange2("Time to rest in a cage", &params.time_to_rest_in_cage_min, &params.time_to_rest_in_cage_max, 10.f, 0.f, 10000.f);
+		if (changed) {
+			try {
+				params.validate();
+				params_ = params;
+				simulation_->access([this] { canvas_->setParams(params_); });
+			} catch (const std::invalid_argument&) {
+				// a range that is being dragged can be inverted for a frame, keep the last valid parameters
+			}
+		}
+	}
+
+#if SIMULATION_PROFILER
+	/**
+	 * Time of every scope in the last frames, summed over the threads, and a histogram of the selected scope.
+	 * A recorded trace is saved to the saves directory and opens in chrome://tracing or Perfetto.
+	 **/
+	void drawProfiler_() {
+		static std::string selected_scope = "CageMediator::update";
+		static std::string trace_message;
+		Profiler& profiler = Profiler::instance();
+
+		ImGui::Begin("Profiler");
+		bool recording = profiler.recording();
+		if (ImGui::Checkbox("Record trace", &recording)) {
+			profiler.setRecording(recording);
+		}
+		ImGui::SameLine();
+		ImGui::Text("%zu events", profiler.traceSize());
+		ImGui::SameLine();
+		if (ImGui::Button("Save trace")) {
+			const std::string path = DIRECTORY_FOR_SAVES + "/trace-" + getTimesStamp() + ".json";
+			try {
+				std::filesystem::create_directory(DIRECTORY_FOR_SAVES);
+				profiler.writeChromeTrace(path);
+				profiler.clearTrace();
+				trace_message = "Saved " + path;
+			} catch (const std::exception& e) {
+				trace_message = e.what();
+			}
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear trace")) {
+			profiler.clearTrace();
+		}
+		if (!trace_message.empty()) {
+			ImGui::Text("%s", trace_message.c_str());
+		}
+		if (profiler.dropped() > 0) {
+			ImGui::TextColored(RED_COLOR, "%zu events dropped", profiler.dropped());
+		}
+
+		if (ImGui::BeginTable("Scopes", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+			for (const char* header : { "scope", "calls", "last ms", "mean ms", "max ms" }) {
+				ImGui::TableSetupColumn(header);
+			}
+			ImGui::TableHeadersRow();
+			for (const auto& [name, history] : profiler.scopes()) {
+				float sum = 0, max = 0;
+				for (float milliseconds : history.milliseconds) {
+					sum += milliseconds;
+					max = std::max(max, milliseconds);
+				}
+				const float last = history.milliseconds[(history.offset + Profiler::HISTORY - 1) % Profiler::HISTORY];
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				if (ImGui::Selectable(name.c_str(), name == selected_scope, ImGuiSelectableFlags_SpanAllColumns)) {
+					selected_scope = name;
+				}
+				ImGui::TableNextColumn();
+				ImGui::Text("%d", history.calls);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", last);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", sum / Profiler::HISTORY);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", max);
+			}
+			ImGui::EndTable();
+		}
+
+		static ImPlotAxisFlags flags = ImPlotAxisFlags_AutoFit | ImPlotAxisFlags_RangeFit;
+		if (ImPlot::BeginPlot("Frames", "frame", "ms", ImVec2(700, 250), 0, flags, flags)) {
+			for (const auto& [name, history] : profiler.scopes()) {
+				ImPlot::PlotLine(name.c_str(), history.milliseconds.data(), static_cast<int>(Profiler::HISTORY), 1., 0., history.offset);
+			}
+			ImPlot::EndPlot();
+		}
+		const auto selected = profiler.scopes().find(selected_scope);
+		if (selected != profiler.scopes().end() && ImPlot::BeginPlot("Histogram", "ms", "frames", ImVec2(700, 250), 0, flags, flags)) {
+			ImPlot::PlotHistogram(selected_scope.c_str(), selected->second.milliseconds.data(), static_cast<int>(Profiler::HISTORY));
+			ImPlot::EndPlot();
+		}
+		ImGui::End();
+	}
+#endif
+
+	/**
+	 * Replicas of the last loaded save file with different seeds, shown as the median and the 5%-95% band.
+	 **/
+	void drawEnsemble_() {
+		static int replicas = 100;
+		static int steps = 2000;
+		static char infected_cage[128] = "";
+		static int number_of_infected = 1;
+		static std::string ensemble_error;
+
+		ImGui::Begin("Ensemble");
+		ImGui::PushItemWidth(100);
+		ImGui::InputInt("Replicas", &replicas);
+		ImGui::SameLine();
+		ImGui::InputInt("Steps", &steps);
+		ImGui::InputText("Infected cage", infected_cage, IM_ARRAYSIZE(infected_cage));
+		ImGui::SameLine();
+		ImGui::InputInt("Infected", &number_of_infected);
+		ImGui::PopItemWidth();
+
+		// the pool is set once before the simulation starts
+		ThreadPool* thread_pool = canvas_->getThreadPool();
+		if (loaded_file_.empty() || !thread_pool) {
+			ImGui::Text("Load a save file to run an ensemble of it.");
+		} else if (ensemble_task_.running()) {
+			if (ImGui::Button("Stop")) {
+				ensemble_task_.cancel();
+			}
+		} else if (ImGui::Button("Run ensemble") && replicas > 0 && steps > 0) {
+			EnsembleOptions options;
+			options.save_file = loaded_file_;
+			options.params = params_;
+			if (std::strlen(infected_cage)) {
+				options.infected.emplace_back(infected_cage, number_of_infected);
+			}
+			options.replicas = static_cast<size_t>(replicas);
+			options.steps = static_cast<uint64_t>(steps);
+			// the window steps about once per frame, record less often so the bands stay small
+			options.record_every = std::max<uint64_t>(1, options.steps / 1000);
+			ensemble_task_.start(*thread_pool, options);
+		}
+
+		ensemble_task_.snapshot(ensemble_bands_, ensemble_error);
+		if (!ensemble_error.empty()) {
+			ImGui::TextColored(RED_COLOR, "%s", ensemble_error.c_str());
+		}
+		static ImPlotAxisFlags flags = ImPlotAxisFlags_AutoFit | ImPlotAxisFlags_RangeFit;
+		if (ImPlot::BeginPlot("Ensemble", "time", "people", ImVec2(700, 400), 0, flags, flags)) {
+			const char* names[] = { "Susceptible", "Infected", "Recovered", "Dead" };
+			const int count = static_cast<int>(ensemble_bands_.time.size());
+			ImPlot::PushStyleVar(ImPlotStyleVar_FillAlpha, 0.25f);
+			for (size_t channel = 0; channel < 4; channel++) {
+				// the band and the line share the label, so they share the colour and the legend entry
+				ImPlot::PlotShaded(names[channel], ensemble_bands_.time.data(), ensemble_bands_.low[channel].data(), ensemble_bands_.high[channel].data(), count);
+				ImPlot::PlotLine(names[channel], ensemble_bands_.time.data(), ensemble_bands_.median[channel].data(), count);
+			}
+			ImPlot::PopStyleVar();
+			ImPlot::EndPlot();
+		}
+		ImGui::End();
+	}
+
 	void manageSaveButton() {
 		static char file_name_buffer[128] = "";
 		ImGui::PushItemWidth(100);
@@ -54,21 +348,51 @@ private:
 		ImGui::PopItemWidth();
 		ImGui::SameLine();
 		if (ImGui::Button("Save")) {
-			file_name_ = cage_mediator_->save(std::string(file_name_buffer));
+			simulation_->access([this] { file_name_ = cage_mediator_->save(std::string(file_name_buffer)); });
 			save_ = UserInputMessage::SAVE_CREATED;
 		}
+		ImGui::SameLine();
+		if (ImGui::Button("Save checkpoint")) {
+			// the checkpoint keeps the whole state, the circles continue from where they are
+			file_name_ = std::string(file_name_buffer) + "-" + getTimesStamp() + CHECKPOINT_EXTENSION;
+			try {
+				std::filesystem::create_directory(DIRECTORY_FOR_SAVES);
+				simulation_->access([this] { Checkpoint::save(DIRECTORY_FOR_SAVES + "/" + file_name_, *canvas_, *cage_mediator_, *clock_); });
+				save_ = UserInputMessage::SAVE_CREATED;
+			} catch (const std::exception& e) {
+				error_ = e.what();
+				save_ = UserInputMessage::FILE_ERROR;
+			}
+		}
 
-		if (save_ == UserInputMessage::SAVE_CREATED) {
-			chooseUserInputMessage(save_, {{"file_name", file_name_}});
+		if (save_ == UserInputMessage::SAVE_CREATED || save_ == UserInputMessage::FILE_ERROR) {
+			chooseUserInputMessage(save_, {{"file_name", file_name_}, {"error", error_}});
 		}
 	}
 
 	void manageLoadButton() {
 		for (const auto& entry : std::filesystem::directory_iterator(DIRECTORY_FOR_SAVES)) {
 			if (ImGui::Button(entry.path().string().c_str())) {
-				cage_mediator_->load(entry.path().string());
+				try {
+					simulation_->access([this, &entry] {
+						if (entry.path().extension() == CHECKPOINT_EXTENSION) {
+							Checkpoint::restore(entry.path().string(), *canvas_, *cage_mediator_, *clock_);
+						} else {
+							cage_mediator_->load(entry.path().string());
+							loaded_file_ = entry.path().string();
+						}
+						params_ = canvas_->getParams();
+						// a loaded simulation waits until the user starts it
+						SIMULATION_SPEED = 0;
+					});
+					load_ = UserInputMessage::INITIAL;
+				} catch (const std::exception& e) {
+					error_ = e.what();
+					load_ = UserInputMessage::FILE_ERROR;
+				}
 			}
 		}
+		chooseUserInputMessage(load_, {{"error", error_}});
 	}
 	
 	void manageAddFlowButton() {
@@ -82,31 +406,49 @@ private:
 			ImGui::InputInt("Input number of moving circles", &number_of_moving_circles);
 			ImGui::PopItemWidth();
 			if (ImGui::Button("Add flow!")) {
-				if (!std::strlen(source_cage_name) || !std::strlen(destination_cage_name)) {
-					add_flow_state_ = UserInputMessage::EMPTY_NAME;
-				} else if (std::strcmp(source_cage_name, destination_cage_name) == 0) {
-					add_flow_state_ = UserInputMessage::DUPLICATED_NAME;
-				} else {
-					add_flow_state_ = UserInputMessage::SUCCESS;
-					cage_mediator_->addDestination(Flow(std::string(source_cage_name), std::string(destination_cage_name), number_of_moving_circles));
-				}
+				simulation_->access([this] {
+					if (!std::strlen(source_cage_name) || !std::strlen(destination_cage_name)) {
+						add_flow_state_ = UserInputMessage::EMPTY_NAME;
+					} else if (std::strcmp(source_cage_name, destination_cage_name) == 0) {
+						add_flow_state_ = UserInputMessage::DUPLICATED_NAME;
+					} else if (canvas_->findCageId(source_cage_name) == NO_CAGE || canvas_->findCageId(destination_cage_name) == NO_CAGE) {
+						add_flow_state_ = UserInputMessage::UNKNOWN_CAGE;
+					} else {
+						add_flow_state_ = UserInputMessage::SUCCESS;
+						cage_mediator_->addDestination(Flow(canvas_->findCageId(source_cage_name), canvas_->findCageId(destination_cage_name), number_of_moving_circles));
+					}
+				});
 			}
 			chooseUserInputMessage(add_flow_state_);
 			ImGui::TreePop();
 		}
 	}
 	
-	void manageCageControls(float scaled_current_time) {
+	void manageCageControls(const CanvasSnapshot& snapshot) {
 		static int population_to_infect = 1;
-		for (auto& [cage_name, cage] : canvas_->getCages()) {
-			if (ImGui::TreeNode(cage_name.c_str())) {
+		for (size_t c = 0; c < snapshot.cages.size(); c++) {
+			const CageId id = static_cast<CageId>(c);
+			if (ImGui::TreeNode(snapshot.cages[c].name.c_str())) {
+				// the snapshot can be a step older than the canvas, a cage that is gone is left alone
 				if (ImGui::Button("Repopulate")) {
-					cage.repopulate();
+					simulation_->access([this, id] {
+						if (id < static_cast<CageId>(canvas_->getCages().size())) {
+							canvas_->repopulate(id);
+						}
+					});
 				}
 				ImGui::SameLine();
 				
 				if (ImGui::Button("Populate infected")) {
-					cage.populateInfected(population_to_infect, scaled_current_time);
+					try {
+						simulation_->access([this, id] {
+							if (id < static_cast<CageId>(canvas_->getCages().size())) {
+								canvas_->populateInfected(id, population_to_infect, clock_->current_time);
+							}
+						});
+					} catch (const std::out_of_range&) {
+						// more circles than the cage has susceptible ones, nobody is infected
+					}
 				}
 				ImGui::PushItemWidth(100);
 				ImGui::InputInt("Input size of population to infect", &population_to_infect);
@@ -129,20 +471,22 @@ private:
 			ImGui::PopItemWidth();
 			
 			if (ImGui::Button("Add cage!")) {
-				if (population_size > 1000) {
-					add_cage_state_ = UserInputMessage::WRONG_POPULATION_SIZE;
-				} else if (!std::strlen(cage_name)) {
-					add_cage_state_ = UserInputMessage::EMPTY_NAME;
-				} else if (!canvas_->isCageNameRepeats(cage_name)) {
-					add_cage_state_ = UserInputMessage::REPEATED_NAME;
-				} else if (!canvas_->isCoordinatesValid(left_corner, size)) {
-					add_cage_state_ = UserInputMessage::INVALID_COORDINATES;
-				} else if (!canvas_->isOverlapCages(left_corner, size)) {
-					add_cage_state_ = UserInputMessage::OVERLAPPING;
-				} else {
-					add_cage_state_ = UserInputMessage::SUCCESS;
-					canvas_->addCage(Cage(population_size, Coordinates(glm::vec2(left_corner[0], left_corner[1]), size[1], size[0]), cage_name));
-				}
+				simulation_->access([this] {
+					if (population_size > 1000) {
+						add_cage_state_ = UserInputMessage::WRONG_POPULATION_SIZE;
+					} else if (!std::strlen(cage_name)) {
+						add_cage_state_ = UserInputMessage::EMPTY_NAME;
+					} else if (!canvas_->isCageNameRepeats(cage_name)) {
+						add_cage_state_ = UserInputMessage::REPEATED_NAME;
+					} else if (!canvas_->isCoordinatesValid(left_corner, size)) {
+						add_cage_state_ = UserInputMessage::INVALID_COORDINATES;
+					} else if (!canvas_->isOverlapCages(left_corner, size)) {
+						add_cage_state_ = UserInputMessage::OVERLAPPING;
+					} else {
+						add_cage_state_ = UserInputMessage::SUCCESS;
+						canvas_->addCage(Cage(population_size, Coordinates(glm::vec2(left_corner[0], left_corner[1]), size[1], size[0]), cage_name));
+					}
+				});
 			}
 
 			chooseUserInputMessage(add_cage_state_);
@@ -165,6 +509,10 @@ private:
 			ImGui::TextColored(RED_COLOR, "Please check input parameters. \nCage with such name already exists."); break;
 		case UserInputMessage::DUPLICATED_NAME:
 			ImGui::TextColored(RED_COLOR, "Please check input parameters. \nNames of the cages should not be equal."); break;
+		case UserInputMessage::UNKNOWN_CAGE:
+			ImGui::TextColored(RED_COLOR, "Please check input parameters. \nCage with such name does not exist."); break;
+		case UserInputMessage::FILE_ERROR:
+			ImGui::TextColored(RED_COLOR, "%s", params["error"].c_str()); break;
 		case UserInputMessage::SAVE_CREATED:
 			ImGui::TextColored(GREEN_COLOR, ("Save was created in file \"" + params["file_name"] + "\"").c_str());
 		case UserInputMessage::SUCCESS:
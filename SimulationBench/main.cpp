@@ -0,0 +1,529 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif !defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+#include "imgui.h"
+
+#include "settings.h"
+#include "simulation_clock.h"
+#include "thread_pool.h"
+#include "canvas.h"
+#include "cage_mediator.h"
+#include "canvas_renderer.h"
+#include "checkpoint.h"
+#include "simulation_stepper.h"
+
+/**
+ *	Benchmarks of the hot paths of the simulation over generated populations.
+ *	Every scenario is a square grid of equal cages with the same density of circles, so the cost per circle
+ *	can be compared between populations. A benchmark repeats its step until it has measured for --min-time
+ *	and reports the time per circle and step, steps per second and the peak resident memory of the scenario.
+ *	Results are written as CSV; with --baseline they are compared with an earlier run and the runner fails
+ *	if a benchmark got slower by more than --tolerance.
+ **/
+
+struct Scenario {
+	size_t population{};
+	size_t cages{};
+	// every cage sends commuters to the next flows cages
+	size_t flows{};
+};
+
+struct BenchOptions {
+	std::vector<size_t> populations = { 1000, 10000, 100000, 1000000 };
+	std::vector<size_t> cage_counts = { 1, 64 };
+	size_t flows = 2;
+	// circles per square pixel of a cage
+	float density = 0.03f;
+	// share of the circles of a cage that commute
+	float commuters = 0.2f;
+	// share of the circles of a cage that are infected at the start
+	float infected = 0.01f;
+	size_t threads = std::max(1u, std::thread::hardware_concurrency());
+	double min_seconds = 0.5;
+	std::vector<std::string> benchmarks;
+	std::string output_file;
+	std::string baseline_file;
+	double tolerance = 0.1;
+};
+
+struct BenchResult {
+	std::string benchmark;
+	Scenario scenario;
+	size_t threads{};
+	uint64_t steps{};
+	double seconds{};
+	double peak_rss_megabytes{};
+
+	double nanosecondsPerAgentStep() const {
+		return seconds * 1e9 / (static_cast<double>(steps) * scenario.population);
+	}
+
+	double stepsPerSecond() const {
+		return steps / seconds;
+	}
+
+	std::string key() const {
+		std::ostringstream out;
+		out << benchmark << "," << scenario.population << "," << scenario.cages << "," << scenario.flows << "," << threads;
+		return out.str();
+	}
+};
+
+struct World {
+	Canvas canvas;
+	CageMediator cage_mediator;
+	SimulationClock clock;
+
+	World(int height, int width) : canvas(glm::vec2(0, 0), height, width), cage_mediator(&canvas) {}
+};
+
+/**
+ * Peak resident memory since the last resetPeakResidentMemory(). Only Linux can reset the peak,
+ * elsewhere it is the peak of the whole process, which is the peak of the scenario while scenarios grow.
+ **/
+double peakResidentMegabytes() {
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters{};
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return counters.PeakWorkingSetSize / 1048576.;
+#elif defined(__linux__)
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0) {
+			return std::atof(line.c_str() + 6) / 1024.;
+		}
+	}
+	return 0;
+#else
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+	return usage.ru_maxrss / 1048576.;
+#else
+	return usage.ru_maxrss / 1024.;
+#endif
+#endif
+}
+
+void resetPeakResidentMemory() {
+#if defined(__linux__)
+	std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+/**
+ * A grid of scenario.cages square cages with gaps between them, big enough for the density.
+ * The first cages get the circles that do not divide evenly.
+ **/
+std::unique_ptr<World> buildWorld(const Scenario& scenario, const BenchOptions& options, ThreadPool& thread_pool) {
+	const size_t columns = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(scenario.cages))));
+	const size_t rows = (scenario.cages + columns - 1) / columns;
+	const double circles_per_cage = static_cast<double>(scenario.population) / scenario.cages;
+	const int cage_size = std::max(4 * static_cast<int>(CIRCLE_RADIUS), static_cast<int>(std::ceil(std::sqrt(circles_per_cage / options.density))));
+	const int gap = std::max(1, cage_size / 4);
+	const int cell = cage_size + gap;
+
+	auto world = std::make_unique<World>(static_cast<int>(rows) * cell + gap, static_cast<int>(columns) * cell + gap);
+	world->canvas.setThreadPool(&thread_pool);
+	for (size_t c = 0; c < scenario.cages; c++) {
+		const int population = static_cast<int>(scenario.population / scenario.cages + (c < scenario.population % scenario.cages ? 1 : 0));
+		const glm::vec2 corner(gap + static_cast<int>(c % columns) * cell, gap + static_cast<int>(c / columns) * cell);
+		world->canvas.addCage(Cage(population, Coordinates(corner, cage_size, cage_size), "c" + std::to_string(c)));
+	}
+	for (auto& cage : world->canvas.getCages()) {
+		world->canvas.repopulate(cage.id);
+	}
+	if (scenario.cages > 1) {
+		const size_t flows = std::min(scenario.flows, scenario.cages - 1);
+		for (size_t c = 0; c < scenario.cages; c++) {
+			for (size_t f = 1; f <= flows; f++) {
+				const CageId source = static_cast<CageId>(c), destination = static_cast<CageId>((c + f) % scenario.cages);
+				const int amount = static_cast<int>(world->canvas[source].getPopulationSize() * options.commuters / flows);
+				if (amount > 0) {
+					world->cage_mediator.addDestination(Flow(source, destination, amount));
+				}
+			}
+		}
+	}
+	for (auto& cage : world->canvas.getCages()) {
+		const int infected = std::max(1, static_cast<int>(cage.getPopulationSize() * options.infected));
+		if (cage.getPopulationSize() >= infected) {
+			world->canvas.populateInfected(cage.id, infected, world->clock.current_time);
+		}
+	}
+	world->canvas.getGraphData().continue_drawing = false;
+	return world;
+}
+
+/**
+ * Cages that big are updated by all threads, as in Cage::update.
+ **/
+ThreadPool* poolFor(const Cage& cage, ThreadPool& thread_pool) {
+	return cage.getCircles().size() >= static_cast<size_t>(PARALLEL_CAGE_MIN_POPULATION) ? &thread_pool : nullptr;
+}
+
+using Clock = std::chrono::steady_clock;
+
+void resetDrawList(ImDrawList& draw_list) {
+	draw_list._ResetForNewFrame();
+	draw_list.Flags |= ImDrawListFlags_AllowVtxOffset;
+}
+
+double secondsSince(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * step runs one step of a benchmark and returns the seconds of the part that is measured,
+ * so the preparation of a step (moving the circles before the mediator, for example) is not counted.
+ **/
+using BenchStep = std::function<double(World&, ThreadPool&)>;
+
+struct Benchmark {
+	const char* name;
+	BenchStep step;
+};
+
+const std::vector<Benchmark>& benchmarks() {
+	static const std::vector<Benchmark> benchmarks = {
+		{ "step", [](World& world, ThreadPool&) {
+			const auto start = Clock::now();
+			advanceSimulation(world.cage_mediator, world.canvas, world.clock, 1.f);
+			return secondsSince(start);
+		} },
+		{ "cage_update", [](World& world, ThreadPool& thread_pool) {
+			world.clock.advance(1.f);
+			world.cage_mediator.update(world.clock);
+			const auto start = Clock::now();
+			world.canvas.parallelForEachCage([&world, &thread_pool](Cage& cage, size_t) {
+				cage.update(world.clock, world.canvas.getEntities(), &thread_pool);
+			});
+			return secondsSince(start);
+		} },
+		{ "move_circles", [](World& world, ThreadPool& thread_pool) {
+			const auto start = Clock::now();
+			world.canvas.parallelForEachCage([&thread_pool](Cage& cage, size_t) {
+				cage.moveCircles_(1.f, poolFor(cage, thread_pool));
+			});
+			return secondsSince(start);
+		} },
+		{ "mark_intersections", [](World& world, ThreadPool& thread_pool) {
+			world.clock.advance(1.f);
+			const auto start = Clock::now();
+			world.canvas.parallelForEachCage([&world, &thread_pool](Cage& cage, size_t) {
+				cage.markIntersectionCircles_(world.clock.current_time, 1.f, world.clock.step, poolFor(cage, thread_pool));
+			});
+			return secondsSince(start);
+		} },
+		{ "mediator_update", [](World& world, ThreadPool& thread_pool) {
+			world.clock.advance(1.f);
+			world.canvas.parallelForEachCage([&thread_pool](Cage& cage, size_t) {
+				cage.moveCircles_(1.f, poolFor(cage, thread_pool));
+			});
+			const auto start = Clock::now();
+			world.cage_mediator.update(world.clock);
+			return secondsSince(start);
+		} },
+		{ "snapshot", [](World& world, ThreadPool&) {
+			static CanvasSnapshot snapshot;
+			// every cage as circles, the most a snapshot copies
+			const auto start = Clock::now();
+			snapshot.capture(world.canvas, world.clock, std::numeric_limits<int>::max());
+			return secondsSince(start);
+		} },
+		{ "draw_circles", [](World& world, ThreadPool&) {
+			static ImDrawList draw_list(ImGui::GetDrawListSharedData());
+			static CanvasSnapshot snapshot;
+			snapshot.capture(world.canvas, world.clock, std::numeric_limits<int>::max());
+			const auto start = Clock::now();
+			resetDrawList(draw_list);
+			CanvasRenderer().drawCircles(&draw_list, snapshot);
+			return secondsSince(start);
+		} },
+		{ "draw_heatmap", [](World& world, ThreadPool&) {
+			static ImDrawList draw_list(ImGui::GetDrawListSharedData());
+			static CanvasSnapshot snapshot;
+			snapshot.capture(world.canvas, world.clock, 1);
+			const auto start = Clock::now();
+			resetDrawList(draw_list);
+			CanvasRenderer renderer;
+			renderer.drawHeatmaps(&draw_list, snapshot);
+			renderer.drawCircles(&draw_list, snapshot);
+			return secondsSince(start);
+		} },
+		{ "populate", [](World& world, ThreadPool&) {
+			const auto start = Clock::now();
+			for (auto& cage : world.canvas.getCages()) {
+				world.canvas.repopulate(cage.id);
+			}
+			return secondsSince(start);
+		} },
+		{ "save_load", [](World& world, ThreadPool&) {
+			const auto start = Clock::now();
+			const std::string file_name = world.cage_mediator.save("bench");
+			const std::string path = DIRECTORY_FOR_SAVES + "/" + file_name;
+			world.cage_mediator.load(path);
+			const double seconds = secondsSince(start);
+			std::filesystem::remove(path);
+			return seconds;
+		} },
+		{ "checkpoint", [](World& world, ThreadPool&) {
+			const std::string path = DIRECTORY_FOR_SAVES + "/bench.ckpt";
+			const auto start = Clock::now();
+			Checkpoint::save(path, world.canvas, world.cage_mediator, world.clock);
+			Checkpoint::restore(path, world.canvas, world.cage_mediator, world.clock);
+			const double seconds = secondsSince(start);
+			std::filesystem::remove(path);
+			return seconds;
+		} },
+	};
+	return benchmarks;
+}
+
+/**
+ * Two steps warm the caches up, then steps are measured until min_seconds have been measured,
+ * or until four times as long has passed when most of the time goes to the preparation.
+ **/
+BenchResult runBenchmark(const Benchmark& benchmark, World& world, const Scenario& scenario, const BenchOptions& options, ThreadPool& thread_pool) {
+	for (int k = 0; k < 2; k++) {
+		benchmark.step(world, thread_pool);
+	}
+	BenchResult result;
+	result.benchmark = benchmark.name;
+	result.scenario = scenario;
+	result.threads = options.threads;
+	const auto start = Clock::now();
+	while (result.steps < 3 || (result.seconds < options.min_seconds && secondsSince(start) < 4 * options.min_seconds)) {
+		result.seconds += benchmark.step(world, thread_pool);
+		result.steps++;
+	}
+	result.peak_rss_megabytes = peakResidentMegabytes();
+	return result;
+}
+
+bool isSelected(const BenchOptions& options, const std::string& name) {
+	return options.benchmarks.empty() || std::find(options.benchmarks.begin(), options.benchmarks.end(), name) != options.benchmarks.end();
+}
+
+/**
+ * Benchmarks that do not move circles between cages run on the scenarios without flows only.
+ **/
+bool needsFlows(const std::string& name) {
+	return name == "step" || name == "mediator_update";
+}
+
+void writeHeader(std::ostream& out) {
+	out << "benchmark,population,cages,flows,threads,steps,seconds,ns_per_agent_step,steps_per_second,peak_rss_mb\n";
+}
+
+void writeRow(std::ostream& out, const BenchResult& result) {
+	out << result.key() << "," << result.steps << "," << result.seconds << ","
+		<< result.nanosecondsPerAgentStep() << "," << result.stepsPerSecond() << "," << result.peak_rss_megabytes << "\n";
+}
+
+/**
+ * ns per agent and step of every benchmark of an earlier result file, by the key of the benchmark.
+ **/
+std::map<std::string, double> readBaseline(const std::string& file_name) {
+	std::ifstream in(file_name);
+	if (!in) {
+		throw std::runtime_error("Could not open the baseline " + file_name);
+	}
+	std::map<std::string, double> baseline;
+	std::string line;
+	std::getline(in, line);
+	while (std::getline(in, line)) {
+		std::vector<std::string> columns;
+		std::istringstream row(line);
+		for (std::string column; std::getline(row, column, ',');) {
+			columns.push_back(column);
+		}
+		if (columns.size() < 8) continue;
+		baseline[columns[0] + "," + columns[1] + "," + columns[2] + "," + columns[3] + "," + columns[4]] = std::atof(columns[7].c_str());
+	}
+	return baseline;
+}
+
+/**
+ * "1000,10k,1M"
+ **/
+bool parseCounts(const char* text, std::vector<size_t>& counts) {
+	counts.clear();
+	std::istringstream in(text);
+	for (std::string item; std::getline(in, item, ',');) {
+		char* end = nullptr;
+		double count = std::strtod(item.c_str(), &end);
+		if (end == item.c_str()) return false;
+		if (*end == 'k' || *end == 'K') count *= 1e3, end++;
+		else if (*end == 'm' || *end == 'M') count *= 1e6, end++;
+		if (*end || count < 1) return false;
+		counts.push_back(static_cast<size_t>(count));
+	}
+	return !counts.empty();
+}
+
+void printUsage() {
+	std::cerr
+		<< "Usage: simulation-bench [options]\n"
+		<< "  --populations <list>    numbers of circles, e.g. 1k,10k,100k,1M (default)\n"
+		<< "  --cages <list>          numbers of cages of every population (default 1,64)\n"
+		<< "  --flows <n>             every cage sends commuters to the next n cages (default 2)\n"
+		<< "  --density <d>           circles per square pixel of a cage (default 0.03)\n"
+		<< "  --commuters <share>     share of the circles of a cage that commute (default 0.2)\n"
+		<< "  --threads <n>           number of threads (default: number of cores)\n"
+		<< "  --min-time <seconds>    measure every benchmark at least this long (default 0.5)\n"
+		<< "  --only <list>           run only these benchmarks: step, cage_update, move_circles, mark_intersections,\n"
+		<< "                          mediator_update, snapshot, draw_circles, draw_heatmap, populate, save_load,\n"
+		<< "                          checkpoint\n"
+		<< "  --output <file>         write the results to the file instead of the standard output\n"
+		<< "  --baseline <file>       compare with the results of an earlier run, fail if a benchmark is slower\n"
+		<< "  --tolerance <share>     slowdown allowed by --baseline (default 0.1)\n";
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--populations") && i + 1 < argc) {
+			if (!parseCounts(argv[++i], options.populations)) return false;
+		} else if (!std::strcmp(argv[i], "--cages") && i + 1 < argc) {
+			if (!parseCounts(argv[++i], options.cage_counts)) return false;
+		} else if (!std::strcmp(argv[i], "--flows") && i + 1 < argc) {
+			options.flows = std::strtoul(argv[++i], nullptr, 10);
+		} else if (!std::strcmp(argv[i], "--density") && i + 1 < argc) {
+			options.density = static_cast<float>(std::atof(argv[++i]));
+		} else if (!std::strcmp(argv[i], "--commuters") && i + 1 < argc) {
+			options.commuters = static_cast<float>(std::atof(argv[++i]));
+		} else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+			options.threads = std::strtoul(argv[++i], nullptr, 10);
+		} else if (!std::strcmp(argv[i], "--min-time") && i + 1 < argc) {
+			options.min_seconds = std::atof(argv[++i]);
+		} else if (!std::strcmp(argv[i], "--only") && i + 1 < argc) {
+			std::istringstream in(argv[++i]);
+			for (std::string name; std::getline(in, name, ',');) {
+				options.benchmarks.push_back(name);
+			}
+		} else if (!std::strcmp(argv[i], "--output") && i + 1 < argc) {
+			options.output_file = argv[++i];
+		} else if (!std::strcmp(argv[i], "--baseline") && i + 1 < argc) {
+			options.baseline_file = argv[++i];
+		} else if (!std::strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+			options.tolerance = std::atof(argv[++i]);
+		} else {
+			return false;
+		}
+	}
+	for (const auto& name : options.benchmarks) {
+		const auto& all = benchmarks();
+		if (std::none_of(all.begin(), all.end(), [&name](const Benchmark& benchmark) { return name == benchmark.name; })) return false;
+	}
+	return options.density > 0 && options.commuters >= 0 && options.commuters <= 1 && options.threads > 0 && options.min_seconds > 0 && options.tolerance >= 0;
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		printUsage();
+		return 1;
+	}
+
+	std::ofstream output_file;
+	if (!options.output_file.empty()) {
+		output_file.open(options.output_file);
+		if (!output_file) {
+			std::cerr << "Could not open " << options.output_file << "\n";
+			return 1;
+		}
+	}
+	std::ostream& out = options.output_file.empty() ? std::cout : output_file;
+
+	std::map<std::string, double> baseline;
+	try {
+		if (!options.baseline_file.empty()) {
+			baseline = readBaseline(options.baseline_file);
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	// saves and checkpoints of the benchmarks go to a directory of their own
+	DIRECTORY_FOR_SAVES = (std::filesystem::temp_directory_path() / "simulation-bench").string();
+	std::filesystem::create_directories(DIRECTORY_FOR_SAVES);
+	// the draw list needs the shared data of a context, nothing is drawn on a screen
+	ImGui::CreateContext();
+
+	std::vector<size_t> populations = options.populations;
+	std::sort(populations.begin(), populations.end());
+	ThreadPool thread_pool(options.threads);
+	writeHeader(out);
+	std::cerr << std::left << std::setw(20) << "benchmark" << std::right << std::setw(9) << "circles" << std::setw(7) << "cages"
+		<< std::setw(7) << "flows" << std::setw(14) << "ns/agent/step" << std::setw(12) << "steps/s" << std::setw(12) << "peak MB" << "\n";
+
+	int regressions = 0;
+	try {
+		for (size_t population : populations) {
+			for (size_t cages : options.cage_counts) {
+				const Scenario scenario{ population, std::min(cages, population), cages > 1 ? options.flows : 0 };
+				for (const auto& benchmark : benchmarks()) {
+					if (!isSelected(options, benchmark.name) || (scenario.flows > 0 && !needsFlows(benchmark.name))) continue;
+					// every benchmark starts from the same state of the epidemic
+					resetPeakResidentMemory();
+					std::unique_ptr<World> world = buildWorld(scenario, options, thread_pool);
+					const BenchResult result = runBenchmark(benchmark, *world, scenario, options, thread_pool);
+					writeRow(out, result);
+					out.flush();
+
+					std::cerr << std::left << std::setw(20) << result.benchmark << std::right << std::setw(9) << population << std::setw(7) << scenario.cages
+						<< std::setw(7) << scenario.flows << std::setw(14) << std::setprecision(4) << result.nanosecondsPerAgentStep()
+						<< std::setw(12) << result.stepsPerSecond() << std::setw(12) << result.peak_rss_megabytes;
+					const auto base = baseline.find(result.key());
+					if (base != baseline.end() && base->second > 0) {
+						const double change = result.nanosecondsPerAgentStep() / base->second - 1;
+						std::cerr << std::showpos << std::setw(9) << std::setprecision(3) << change * 100 << "%" << std::noshowpos;
+						if (change > options.tolerance) {
+							std::cerr << " slower";
+							regressions++;
+						}
+					}
+					std::cerr << "\n";
+				}
+			}
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	ImGui::DestroyContext();
+	std::filesystem::remove_all(DIRECTORY_FOR_SAVES);
+	if (regressions > 0) {
+		std::cerr << regressions << " benchmarks are slower than the baseline by more than " << options.tolerance * 100 << "%\n";
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,312 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "settings.h"
+#include "simulation_clock.h"
+#include "thread_pool.h"
+#include "canvas.h"
+#include "cage_mediator.h"
+#include "checkpoint.h"
+#include "ensemble.h"
+#include "metapopulation_model.h"
+#include "metrics_exporter.h"
+#include "simulation_params.h"
+#include "simulation_stepper.h"
+#include "sweep.h"
+
+/**
+ *	Headless runner of the simulation.
+ *	Loads a save file or resumes a checkpoint, runs the requested number of steps as fast as possible
+ *	and writes the number of susceptible, infected, recovered and dead circles after every step.
+ **/
+
+struct CliOptions {
+	std::string save_file;
+	long long steps{};
+	float step_duration = 1.f;
+	uint64_t seed{};
+	size_t threads = std::max(1u, std::thread::hardware_concurrency());
+	long long write_every = 1;
+	std::string output_file;
+	std::string metrics_path;
+	size_t metrics_file_megabytes = 64;
+	size_t replicas{};
+	bool ode = false;
+	bool resume = false;
+	std::string checkpoint_file;
+	std::vector<std::pair<std::string, int>> infected;
+	// parameters given with --set, applied over the defaults or over the parameters of a resumed checkpoint
+	std::vector<std::pair<std::string, float>> params;
+	std::vector<SweepAxis> sweep_axes;
+	size_t latin_hypercube_samples{};
+};
+
+void printUsage() {
+	std::cerr
+		<< "Usage: simulation-cli <save file> <steps> [options]\n"
+		<< "  --dt <time>             simulation time of one step (default 1), longer steps are split into sub-steps\n"
+		<< "  --seed <n>              seed of the random numbers, the same seed gives the same run (default 0)\n"
+		<< "  --threads <n>           number of threads (default: number of cores)\n"
+		<< "  --infect <cage> <n>     infect n circles of the cage before the run, can be repeated\n"
+		<< "  --output <file>         write the series to the file instead of the standard output\n"
+		<< "  --every <n>             write only every n-th step (default 1)\n"
+		<< "  --metrics <path>        write counts of every cage and step timings to <path>-0000.csv, ...\n"
+		<< "  --metrics-file-size <n> start a new metrics file after n megabytes (default 64)\n"
+		<< "  --replicas <n>          run n replicas with seeds seed, seed + 1, ... and write the 5%, 50% and 95%\n"
+		<< "                          quantiles of every number instead of a single run\n"
+		<< "  --ode                   write the deterministic compartmental model of the save file instead of running\n"
+		<< "                          the circles, at the same times\n"
+		<< "  --set <name> <value>    set a parameter: infection_probability, death_probability, recovery_time_min,\n"
+		<< "                          recovery_time_max, time_to_rest_in_cage_min, time_to_rest_in_cage_max\n"
+		<< "  --vary <name> <min> <max> <n>\n"
+		<< "                          sweep the parameter over n values from min to max, can be repeated; every\n"
+		<< "                          combination is run --replicas times (default 1) and a row of results is written per run\n"
+		<< "  --lhs <n>               sweep n configurations of a Latin hypercube over the ranges of --vary instead\n"
+		<< "  --resume                the save file is a checkpoint, continue it (the seed and the parameters are\n"
+		<< "                          taken from it, --set changes them)\n"
+		<< "  --checkpoint <file>     write a checkpoint of the final state to the file\n";
+}
+
+bool parseOptions(int argc, char** argv, CliOptions& options) {
+	if (argc < 3) return false;
+	options.save_file = argv[1];
+	options.steps = std::atoll(argv[2]);
+	for (int i = 3; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--dt") && i + 1 < argc) {
+			options.step_duration = static_cast<float>(std::atof(argv[++i]));
+		} else if (!std::strcmp(argv[i], "--seed") && i + 1 < argc) {
+			options.seed = std::strtoull(argv[++i], nullptr, 10);
+		} else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+			options.threads = std::strtoul(argv[++i], nullptr, 10);
+		} else if (!std::strcmp(argv[i], "--infect") && i + 2 < argc) {
+			options.infected.emplace_back(argv[i + 1], std::atoi(argv[i + 2]));
+			i += 2;
+		} else if (!std::strcmp(argv[i], "--output") && i + 1 < argc) {
+			options.output_file = argv[++i];
+		} else if (!std::strcmp(argv[i], "--every") && i + 1 < argc) {
+			options.write_every = std::atoll(argv[++i]);
+		} else if (!std::strcmp(argv[i], "--metrics") && i + 1 < argc) {
+			options.metrics_path = argv[++i];
+		} else if (!std::strcmp(argv[i], "--metrics-file-size") && i + 1 < argc) {
+			options.metrics_file_megabytes = std::strtoul(argv[++i], nullptr, 10);
+		} else if (!std::strcmp(argv[i], "--replicas") && i + 1 < argc) {
+			options.replicas = std::strtoul(argv[++i], nullptr, 10);
+		} else if (!std::strcmp(argv[i], "--set") && i + 2 < argc) {
+			if (!SimulationParams::isField(argv[i + 1])) return false;
+			options.params.emplace_back(argv[i + 1], static_cast<float>(std::atof(argv[i + 2])));
+			i += 2;
+		} else if (!std::strcmp(argv[i], "--vary") && i + 4 < argc) {
+			options.sweep_axes.push_back(SweepAxis{ argv[i + 1], static_cast<float>(std::atof(argv[i + 2])), static_cast<float>(std::atof(argv[i + 3])), std::strtoul(argv[i + 4], nullptr, 10) });
+			i += 4;
+		} else if (!std::strcmp(argv[i], "--lhs") && i + 1 < argc) {
+			options.latin_hypercube_samples = std::strtoul(argv[++i], nullptr, 10);
+		} else if (!std::strcmp(argv[i], "--ode")) {
+			options.ode = true;
+		} else if (!std::strcmp(argv[i], "--resume")) {
+			options.resume = true;
+		} else if (!std::strcmp(argv[i], "--checkpoint") && i + 1 < argc) {
+			options.checkpoint_file = argv[++i];
+		} else {
+			return false;
+		}
+	}
+	return options.steps > 0 && options.step_duration > 0 && options.write_every > 0 && options.threads > 0 && options.metrics_file_megabytes > 0;
+}
+
+SimulationParams withParams(SimulationParams params, const CliOptions& options) {
+	for (const auto& [name, value] : options.params) {
+		params.set(name, value);
+	}
+	return params;
+}
+
+int runEnsemble(const CliOptions& options, ThreadPool& thread_pool, std::ostream& out) {
+	EnsembleOptions ensemble_options;
+	ensemble_options.save_file = options.save_file;
+	ensemble_options.params = withParams(SimulationParams(), options);
+	ensemble_options.infected = options.infected;
+	ensemble_options.replicas = options.replicas;
+	ensemble_options.first_seed = options.seed;
+	ensemble_options.steps = static_cast<uint64_t>(options.steps);
+	ensemble_options.step_duration = options.step_duration;
+	ensemble_options.record_every = static_cast<uint64_t>(options.write_every);
+
+	out << "step,time";
+	for (const char* name : { "susceptible", "infected", "recovered", "dead" }) {
+		out << "," << name << "_p05," << name << "_p50," << name << "_p95";
+	}
+	out << "\n";
+
+	const auto start = std::chrono::steady_clock::now();
+	try {
+		EnsembleRunner(ensemble_options).run(thread_pool, [&out](const EnsembleRow& row) {
+			out << row.step << "," << row.time;
+			for (size_t channel = 0; channel < 4; channel++) {
+				out << "," << row.low[channel] << "," << row.median[channel] << "," << row.high[channel];
+			}
+			out << "\n";
+		});
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << options.replicas << " replicas of " << options.steps << " steps in " << seconds << " s\n";
+	return 0;
+}
+
+int runSweep(const CliOptions& options, ThreadPool& thread_pool, std::ostream& out) {
+	SweepOptions sweep_options;
+	sweep_options.save_file = options.save_file;
+	sweep_options.base_params = withParams(SimulationParams(), options);
+	sweep_options.axes = options.sweep_axes;
+	if (options.latin_hypercube_samples > 0) {
+		sweep_options.design = SweepDesign::LATIN_HYPERCUBE;
+		sweep_options.samples = options.latin_hypercube_samples;
+	}
+	sweep_options.replicas = std::max<size_t>(1, options.replicas);
+	sweep_options.first_seed = options.seed;
+	sweep_options.steps = static_cast<uint64_t>(options.steps);
+	sweep_options.step_duration = options.step_duration;
+	sweep_options.infected = options.infected;
+
+	const auto start = std::chrono::steady_clock::now();
+	try {
+		SweepEngine engine(sweep_options);
+		const size_t job_count = engine.jobs().size();
+		SweepEngine::writeHeader(out);
+		size_t reported = 0;
+		engine.run(thread_pool, [&out, &reported, job_count](const SweepResult& result) {
+			SweepEngine::writeRow(out, result);
+			if (++reported % 100 == 0) {
+				std::cerr << reported << " of " << job_count << " runs\n";
+			}
+		});
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cerr << job_count << " runs in " << seconds << " s\n";
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	CliOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		printUsage();
+		return 1;
+	}
+
+	std::ofstream output_file;
+	if (!options.output_file.empty()) {
+		output_file.open(options.output_file);
+		if (!output_file) {
+			std::cerr << "Could not open " << options.output_file << "\n";
+			return 1;
+		}
+	}
+	std::ostream& out = options.output_file.empty() ? std::cout : output_file;
+
+	ThreadPool thread_pool(options.threads);
+	if (!options.sweep_axes.empty()) {
+		return runSweep(options, thread_pool, out);
+	}
+	if (options.replicas > 0) {
+		return runEnsemble(options, thread_pool, out);
+	}
+
+	Canvas canvas(glm::vec2(0, 0), VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
+	canvas.setThreadPool(&thread_pool);
+	CageMediator cage_mediator(&canvas);
+	SimulationClock clock;
+	canvas.setSeed(options.seed);
+
+	try {
+		if (options.resume) {
+			Checkpoint::restore(options.save_file, canvas, cage_mediator, clock);
+		} else {
+			cage_mediator.load(options.save_file);
+		}
+		canvas.setParams(withParams(canvas.getParams(), options));
+		for (const auto& [cage_name, number_of_infected] : options.infected) {
+			CageId cage_id = canvas.findCageId(cage_name);
+			if (cage_id == NO_CAGE) {
+				throw std::invalid_argument("There is no cage " + cage_name + " in " + options.save_file);
+			}
+			canvas.populateInfected(cage_id, number_of_infected, clock.current_time);
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	out << "step,time,susceptible,infected,recovered,dead\n";
+
+	if (options.ode) {
+		const auto start = std::chrono::steady_clock::now();
+		const MetapopulationModel model(canvas);
+		const OdeSeries series = model.integrate(clock.current_time, options.steps * options.step_duration, options.write_every * options.step_duration);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		// rows are numbered by the steps of the clock the run would make, sub-steps included
+		const uint64_t steps_per_row = options.write_every * substepCount(options.step_duration);
+		for (size_t k = 1; k < series.time.size(); k++) {
+			out << clock.step + k * steps_per_row << "," << series.time[k] << ","
+				<< series.susceptible[k] << "," << series.infected[k] << "," << series.recovered[k] << "," << series.dead[k] << "\n";
+		}
+		std::cerr << model.groupCount() << " groups of circles, " << options.steps << " steps in " << seconds * 1000 << " ms\n";
+		return 0;
+	}
+
+	std::unique_ptr<MetricsExporter> metrics_exporter;
+	if (!options.metrics_path.empty()) {
+		metrics_exporter = std::make_unique<MetricsExporter>(options.metrics_path, options.metrics_file_megabytes << 20);
+		canvas.setMetricsExporter(metrics_exporter.get());
+	}
+
+	// the series is written to the output, there is no need to keep it in memory
+	canvas.getGraphData().continue_drawing = false;
+
+	const auto start = std::chrono::steady_clock::now();
+	for (long long step = 1; step <= options.steps; step++) {
+		advanceSimulation(cage_mediator, canvas, clock, options.step_duration);
+
+		if (step % options.write_every == 0) {
+			const DiseaseTotals& totals = canvas.getTotals();
+			out << clock.step << "," << clock.current_time << ","
+				<< totals.susceptible << "," << totals.infected << "," << totals.recovered << "," << totals.dead << "\n";
+		}
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << options.steps << " steps in " << seconds << " s (" << options.steps / seconds << " steps/s)\n";
+	int result = 0;
+	if (metrics_exporter) {
+		canvas.setMetricsExporter(nullptr);
+		metrics_exporter->close();
+		if (metrics_exporter->failed()) {
+			std::cerr << metrics_exporter->error() << "\n";
+			result = 1;
+		} else if (metrics_exporter->dropped() > 0) {
+			std::cerr << metrics_exporter->dropped() << " metrics records were dropped because the disk was too slow\n";
+		}
+	}
+
+	if (!options.checkpoint_file.empty()) {
+		try {
+			Checkpoint::save(options.checkpoint_file, canvas, cage_mediator, clock);
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+	}
+	return result;
+}